@@ -0,0 +1,30 @@
+// BenchSupport.h: shared by the benchmarks and the pipeline tests
+#ifndef BENCHSUPPORT_H
+#define BENCHSUPPORT_H
+
+#include <iostream>
+#include <fstream>
+
+// GeDi's default options, for the SYNTHETIC_COVERAGE of each tissue of the
+// synthetic read sets
+static const unsigned int SYNTHETIC_COVERAGE = 20;
+static const char MIN_PHRED = 22 + 33;
+static const int GSA1_MCT = 1;
+static const int GSA2_MCT = 4;
+static const int COVERAGE_UPPER_THRESHOLD = SYNTHETIC_COVERAGE * 4;
+static const int MAX_LOW_CONFIDENCE_POS = 10;
+static const double ECONT = 0;
+static const double ALLELE_FREQ_OF_ERR = 0.1;
+static const int MIN_MAPQ = 42;
+
+class CoutSilencer {
+  // discards everything written to std::cout while alive
+public:
+  CoutSilencer(): null("/dev/null"), saved(std::cout.rdbuf(null.rdbuf())) {}
+  ~CoutSilencer() { std::cout.rdbuf(saved); }
+private:
+  std::ofstream null;
+  std::streambuf *saved;
+};
+
+#endif
@@ -0,0 +1,57 @@
+// BlockingQueue.h
+#ifndef BLOCKINGQUEUE_H
+#define BLOCKINGQUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+template<typename T>
+class BlockingQueue {
+  // An unbounded FIFO connecting a producing stage to a consuming stage.
+  // The producer pushes items then closes the queue. The consumer pops
+  // until pop() returns false. As push() never blocks, a producer never
+  // waits on its consumer, so the two stages cannot deadlock even when
+  // they run one after the other on the same thread.
+
+private:
+  std::deque<T> items;
+  std::mutex lock;
+  std::condition_variable changed;
+  bool closed;
+
+public:
+  BlockingQueue(): closed(false) {}
+
+  void push(T const& item) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      items.push_back(item);
+    }
+    changed.notify_one();
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      closed = true;
+    }
+    changed.notify_all();
+  }
+  // No more items will be pushed
+
+  bool pop(T &item) {
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [this]() { return closed || !items.empty(); });
+    if (items.empty()) {
+      return false;
+    }
+    item = std::move(items.front());
+    items.pop_front();
+    return true;
+  }
+  // Waits for the next item. Returns false once the queue is closed
+  // and empty
+};
+
+#endif
@@ -14,6 +14,11 @@
 #include <mutex>
 #include <cstdlib> // exit
 #include <functional>
+#include <atomic>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "radix.h"
 #include "util_funcs.h"
@@ -21,6 +26,12 @@
 #include "SuffixArray.h"
 #include "Suffix_t.h"
 #include "GenomeMapper.h"
+#include "ScanScheduler.h"
+#include "BlockingQueue.h"
+#include "ThreadPool.h"
+#include "MemoryTracker.h"
+#include "Trace.h"
+#include "OpCounters.h"
 
 #include "benchmark.h"
 
@@ -30,12 +41,91 @@ using namespace std;
 //static const int GSA2_MCT = 4;
 //static const int COVERAGE_UPPER_THRESHOLD = 150;
 static const int READ_LENGTH = 80;
+static const int GSA1_SCAN_FACTOR = 16; // GSA1 scan steps per sorted suffix
+static const unsigned int CONSENSUS_BATCH = 64; // seed blocks per work item
+
+// Pileup base codes. Bits 0-1 index the A, T, C, G counters, and bit 2
+// is set for bases that may be counted. Other characters have code 0.
+struct base_code_table {
+  uint8_t code[256];
+  base_code_table(bool complement) {
+    for (int c=0; c < 256; c++) code[c] = 0;
+    code['A'] = 4 | (complement ? 1 : 0);
+    code['T'] = 4 | (complement ? 0 : 1);
+    code['C'] = 4 | (complement ? 3 : 2);
+    code['G'] = 4 | (complement ? 2 : 3);
+  }
+  uint8_t operator[](uint8_t c) const { return code[c]; }
+};
+static const base_code_table BASE_CODE(false);
+static const base_code_table COMP_BASE_CODE(true);
+static const char CODE_BASE[] = {'A', 'T', 'C', 'G'};
 //static const int GSA1_MCT  = 1;
 //static const int GSA2_MCT = 4;
 //static const char MIN_PHRED_QUAL = '7';
 //static const double ALLELIC_FREQ_OF_ERROR = 0.1;
 
 
+const unsigned int bp_block::LINEAR_SEARCH_MAX;
+
+int bp_block::findPosition(unsigned long long k, unsigned int &s) const {
+  // returns the position in block of the tag with key k, or -1. If not
+  // found, s is left at the empty index slot k would occupy
+  s = slot(k);
+  while (index[s] != 0) {
+    if (key(block[index[s] - 1]) == k) {
+      return index[s] - 1;
+    }
+    s = (s + 1) & (index.size() - 1);
+  }
+  return -1;
+}
+
+void bp_block::rebuildIndex(unsigned int n_slots) {
+  index.assign(n_slots, 0);
+  for (unsigned int pos = 0; pos < block.size(); pos++) {
+    unsigned int s;
+    findPosition(key(block[pos]), s);
+    index[s] = pos + 1;
+  }
+}
+
+bool bp_block::insert(read_tag const& r) {
+  OpCounters::add(OP_BLOCK_INSERTS);
+  if (find(r) != nullptr) {
+    return false;
+  }
+  OpCounters::add(OP_BLOCK_INSERTS_ADDED);
+  block.push_back(r);
+  if (block.size() > LINEAR_SEARCH_MAX) {
+    // keep the index at most half full
+    if (block.size() * 2 > index.size()) {
+      unsigned int n_slots = 64;
+      while (n_slots < block.size() * 4) n_slots <<= 1;
+      rebuildIndex(n_slots);
+    }
+    else {
+      unsigned int s;
+      findPosition(key(r), s);
+      index[s] = block.size();
+    }
+  }
+  return true;
+}
+
+read_tag * bp_block::find(read_tag const& r) {
+  unsigned long long k = key(r);
+  if (index.empty()) {
+    for (read_tag &tag : block) {
+      if (key(tag) == k) return &tag;
+    }
+    return nullptr;
+  }
+  unsigned int s;
+  int pos = findPosition(k, s);
+  return (pos == -1) ? nullptr : &block[pos];
+}
+
 BranchPointGroups::BranchPointGroups(SuffixArray &_SA, 
                                      ReadsManipulator &_reads,
                                      char mpq, int g1, int g2, int cut,
@@ -52,6 +142,7 @@ BranchPointGroups::BranchPointGroups(SuffixArray &_SA,
   if (GSA1_MCT > GSA2_MCT) GSA2_MCT = GSA1_MCT;
   reads = &_reads;  
   SA = &_SA;    
+  pair_stream = nullptr;
   cout << "READ_LENGTH: " << READ_LENGTH << endl;
   cout << "GSA1_MCT : " << GSA1_MCT  << endl;
   cout << "GSA2_MCT: " << GSA2_MCT << endl;
@@ -62,7 +153,7 @@ BranchPointGroups::BranchPointGroups(SuffixArray &_SA,
   cout << "Extracting cancer-specific reads..." << endl;
    extractCancerSpecificReads(); 
   //outputExtractedCancerReads("/data/ic711/point3.txt");
-  cout << "No of extracted reads: " << CancerExtraction.size() << endl;
+  cout << "No of extracted reads: " << CancerExtraction.count() << endl;
 
   // Group blocks covering same mutations in both orientations
   cout << "Seeding breakpoint blocks by constructing GSA2..." << endl;
@@ -76,53 +167,171 @@ BranchPointGroups::BranchPointGroups(SuffixArray &_SA,
   //printAlignedBlocks();
   // buildCancerCNS()
   cout << "Number of seed blocks: " << SeedBlocks.size() << endl;
-  int skipped = 0;
-  for (bp_block &block : SeedBlocks) {
-    consensus_pair pair;
-    pair.left_ohang = pair.right_ohang = 0;
-    generateConsensusSequence(TUMOUR, block, pair.mut_offset, pair.pair_id, pair.mutated, pair.mqual);
-
-    if (block.block.size() > COVERAGE_UPPER_THRESHOLD) {
-      block.block.clear();
-      continue;
-    }
-    extractNonMutatedAlleles(block, pair);
-    generateConsensusSequence(HEALTHY, block, pair.nmut_offset, pair.pair_id, pair.non_mutated, pair.nqual);
-    if (block.block.size() > COVERAGE_UPPER_THRESHOLD) {
-      block.clear();
-      continue;
-    }
-    block.clear();
-    trimHealthyConsensus(pair); // MUST trim healthy first
-    trimCancerConsensus(pair);
-    bool low_quality_block {false};
-    maskLowQualityPositions(pair, low_quality_block);
-    if (low_quality_block) {
-      continue;
-    }
-
-    consensus_pairs.push_back(pair);
-    if (pair.mutated.empty()) {
-      skipped++;
-    }
-   // cout << "Pair id: " << pair.pair_id << endl;
-   // cout << "Tumour: " << endl;
-   // cout << pair.mutated << endl;
-   // cout << pair.mqual << endl;
-   // cout << "Block mutated offset: " << pair.mut_offset << endl;
-   // cout << "Healthy: " << endl;
-   // cout << pair.non_mutated << endl;
-   // cout << pair.nqual << endl;
-   // cout << "Block non_mut offset: " << pair.nmut_offset << endl;
-  } 
-  cout << "n skipped: " << skipped << endl;
-  cout << "DONE BUILDING PAIRS" << endl;
-  cout << "Adding non-mutated alleles to blocks." << endl;
+  // Consensus pairs are built by buildConsensusPairs(), so the caller
+  // can stream them to the next stage as they are built
+  //buildConsensusPairs();
   //extractNonMutatedAlleles();
   //outputFromBPB("/data/ic711/point5.txt");
   cout << "Finished break point block construction" << endl;
 }
 
+void BranchPointGroups::buildConsensusPairs(int n_threads,
+    BlockingQueue<consensus_pair> *stream) {
+  // Each seed block is independent, so blocks are handed to pool 
+  // workers in small batches. Results are stored by block index. Finished batches
+  // are emitted in block order as soon as all earlier batches are done,
+  // so consensus_pairs (and stream) remain in pair_id order regardless 
+  // of the thread count, and a consumer of stream can start early.
+  vector<consensus_pair> results(SeedBlocks.size());
+  vector<char> accepted(SeedBlocks.size(), false);
+  MemoryTracker::global().set("consensus results", 
+                              MemoryTracker::vectorBytes(results));
+  unsigned int n_batches = (SeedBlocks.size() + CONSENSUS_BATCH - 1) / 
+                           CONSENSUS_BATCH;
+  batch_done.assign(n_batches, false);
+  emit_batch = 0;
+  n_skipped = 0;
+  pair_stream = stream;
+
+  // The stream is closed however this returns. If a batch throws, the
+  // consumer must still see the end of the stream, or it would wait
+  // forever and the pipeline would never get to rethrow.
+  struct stream_closer {
+    BranchPointGroups *groups;
+    ~stream_closer() {
+      if (groups->pair_stream != nullptr) {
+        groups->pair_stream->close();
+      }
+      groups->pair_stream = nullptr;
+    }
+  } closer = {this};
+
+  // scratch buffers are reused by every batch a worker builds
+  WorkerLocal<consensus_scratch> scratch(ThreadPool::global());
+  ThreadPool::global().parallelFor(n_batches, [&](unsigned int batch) {
+    buildConsensusBatch(batch, &results, &accepted, scratch.local());
+  }, n_threads);
+  results = vector<consensus_pair>();
+  MemoryTracker::global().release("consensus results");
+  MemoryTracker::global().set("SeedBlocks", seedBlocksBytes());
+  cout << "n skipped: " << n_skipped << endl;
+  cout << "DONE BUILDING PAIRS" << endl;
+}
+
+void BranchPointGroups::buildConsensusBatch(unsigned int batch,
+    vector<consensus_pair> *results, vector<char> *accepted,
+    consensus_scratch &scratch) {
+  if (before_consensus_batch) {
+    before_consensus_batch(batch);
+  }
+  unsigned int from = batch * CONSENSUS_BATCH;
+  unsigned int to = from + CONSENSUS_BATCH;
+  if (to > SeedBlocks.size()) to = SeedBlocks.size();
+  long long released = 0;
+  for (unsigned int i = from; i < to; i++) {
+    // extend a copy in the worker's scratch block, and free the seed
+    Trace::Span span("consensus block", "block", SeedBlocks[i].id);
+    scratch.block.clear();
+    scratch.block.id = SeedBlocks[i].id;
+    for (read_tag const& tag : SeedBlocks[i].block) {
+      scratch.block.insert(tag);
+    }
+    released += SeedBlocks[i].bytes();
+    SeedBlocks[i].release();
+    (*accepted)[i] = buildConsensusPair(scratch.block, (*results)[i], scratch);
+  }
+  MemoryTracker::global().add("SeedBlocks", -released);
+  emitBatches(batch, results, accepted);
+}
+
+void BranchPointGroups::emitBatches(unsigned int batch,
+    vector<consensus_pair> *results, vector<char> *accepted) {
+  Trace::Span span("emit batches", "batch", batch);  // includes lock wait
+  std::lock_guard<std::mutex> lock(emit_lock);
+  batch_done[batch] = true;
+  size_t capacity = consensus_pairs.capacity();
+  long long added = 0;
+  for (; emit_batch < batch_done.size() && batch_done[emit_batch]; 
+       emit_batch++) {
+    unsigned int from = emit_batch * CONSENSUS_BATCH;
+    unsigned int to = from + CONSENSUS_BATCH;
+    if (to > results->size()) to = results->size();
+    for (unsigned int i = from; i < to; i++) {
+      if (!(*accepted)[i]) continue;
+      if ((*results)[i].mutated.empty()) {
+        n_skipped++;
+      }
+      if (pair_stream != nullptr) {
+        pair_stream->push((*results)[i]);
+      }
+      consensus_pairs.push_back(std::move((*results)[i]));
+      added += pairBytes(consensus_pairs.back());
+    }
+  }
+  added += (consensus_pairs.capacity() - capacity) * sizeof(consensus_pair);
+  if (added > 0) {
+    MemoryTracker::global().add("consensus_pairs", added);
+  }
+}
+
+size_t BranchPointGroups::seedBlocksBytes() const {
+  size_t bytes = MemoryTracker::vectorBytes(SeedBlocks);
+  for (bp_block const& block : SeedBlocks) {
+    bytes += block.bytes();
+  }
+  return bytes;
+}
+
+size_t BranchPointGroups::pairBytes(consensus_pair const& pair) {
+  return MemoryTracker::stringBytes(pair.mutated) +
+         MemoryTracker::stringBytes(pair.non_mutated) +
+         MemoryTracker::stringBytes(pair.mqual) +
+         MemoryTracker::stringBytes(pair.nqual) +
+         MemoryTracker::vectorBytes(pair.mutations.SNV_pos);
+}
+
+bool BranchPointGroups::buildConsensusPair(bp_block &block, 
+    consensus_pair &pair, consensus_scratch &scratch) {
+  pair.left_ohang = pair.right_ohang = 0;
+  if (block.size() > COVERAGE_UPPER_THRESHOLD) {
+    block.clear();
+    return false;
+  }
+  generateConsensusSequence(TUMOUR, block, pair.mut_offset, pair.pair_id, 
+      pair.mutated, pair.mqual, scratch);
+
+  // extension stops as soon as the block passes the threshold, so
+  // a rejected block is never piled up
+  bool extended = extractNonMutatedAlleles(block, pair);
+  OpCounters::add(OP_BLOCKS);
+  OpCounters::add(OP_BLOCK_TAGS, block.size());
+  OpCounters::max(OP_MAX_BLOCK_TAGS, block.size());
+  if (!extended) {
+    block.clear();
+    return false;
+  }
+  generateConsensusSequence(HEALTHY, block, pair.nmut_offset, pair.pair_id, 
+      pair.non_mutated, pair.nqual, scratch);
+  block.clear();
+  trimHealthyConsensus(pair); // MUST trim healthy first
+  trimCancerConsensus(pair);
+  bool low_quality_block {false};
+  maskLowQualityPositions(pair, low_quality_block);
+  if (low_quality_block) {
+    return false;
+  }
+  // cout << "Pair id: " << pair.pair_id << endl;
+  // cout << "Tumour: " << endl;
+  // cout << pair.mutated << endl;
+  // cout << pair.mqual << endl;
+  // cout << "Block mutated offset: " << pair.mut_offset << endl;
+  // cout << "Healthy: " << endl;
+  // cout << pair.non_mutated << endl;
+  // cout << pair.nqual << endl;
+  // cout << "Block non_mut offset: " << pair.nmut_offset << endl;
+  return true;
+}
+
 void BranchPointGroups::maskLowQualityPositions(consensus_pair & pair, bool &
     low_quality) {
   int low_quality_count{0};
@@ -176,9 +385,10 @@ void BranchPointGroups::trimHealthyConsensus(consensus_pair & pair) {
   pair.nmut_offset -= left_arrow;
 }
 
-void BranchPointGroups::extractNonMutatedAlleles(bp_block &block,
+bool BranchPointGroups::extractNonMutatedAlleles(bp_block &block,
     consensus_pair &pair) {
   bool LEFT{false}, RIGHT{true};
+  bool over_threshold{false};
   string query = pair.mutated.substr(pair.mut_offset, 30);
   string rcquery = reverseComplementString(query);
   long long int fwd_idx = binarySearch(query);
@@ -186,10 +396,13 @@ void BranchPointGroups::extractNonMutatedAlleles(bp_block &block,
 
   bool success_left{false}, success_right{false};
   if (fwd_idx != -1) {
-    success_right = extendBlock(fwd_idx, block.block, RIGHT, 0);
+    success_right = extendBlock(fwd_idx, block, RIGHT, 0, over_threshold);
+  }
+  if (rev_idx != -1 && !over_threshold) {
+    success_left = extendBlock(rev_idx, block, LEFT, 0, over_threshold);
   }
-  if (rev_idx != -1) {
-    success_left = extendBlock(rev_idx, block.block, LEFT, 0);
+  if (over_threshold) {
+    return false;
   }
   if (!(success_left || success_right)) {
     // then perform flanking search
@@ -204,13 +417,19 @@ void BranchPointGroups::extractNonMutatedAlleles(bp_block &block,
       fwd_idx = binarySearch(query);
       rev_idx = binarySearch(rcquery);
       if (fwd_idx != -1) {
-        extendBlock(fwd_idx, block.block, RIGHT, pair.mut_offset - i);
+        extendBlock(fwd_idx, block, RIGHT, pair.mut_offset - i,
+            over_threshold);
       }
-      if (rev_idx != -1) {
-        extendBlock(rev_idx, block.block, LEFT, pair.mut_offset - i);
+      if (rev_idx != -1 && !over_threshold) {
+        extendBlock(rev_idx, block, LEFT, pair.mut_offset - i,
+            over_threshold);
+      }
+      if (over_threshold) {
+        return false;
       }
     }
   }
+  return true;
 }
 
 //void BranchPointGroups::extractNonMutatedAlleles(bp_block &block, consensus_pair
@@ -328,9 +547,10 @@ void BranchPointGroups::extractNonMutatedAlleles(bp_block &block,
 
 void BranchPointGroups::generateConsensusSequence(bool tissue,
     bp_block const& block, int & cns_offset, unsigned int & pair_id, string & cns,
-    string & qual) {
+    string & qual, consensus_scratch & scratch) {
 
-  std::vector<read_tag> subBlock;            // work with subset
+  std::vector<read_tag> &subBlock = scratch.sub_block;  // work with subset
+  subBlock.clear();
   for (read_tag const& tag : block.block) {
     if (tissue == HEALTHY  && 
        (tag.tissue_type == HEALTHY || tag.tissue_type == SWITCHED)) {
@@ -343,6 +563,7 @@ void BranchPointGroups::generateConsensusSequence(bool tissue,
 
   int max_offset = 0;
   int min_offset = std::numeric_limits<int>::max();
+  int max_read_length = READ_LENGTH;
   for (read_tag &tag : subBlock) {
     if (tag.orientation == LEFT) {
       tag.offset = convertOffset(tag);
@@ -353,83 +574,70 @@ void BranchPointGroups::generateConsensusSequence(bool tissue,
     if (tag.offset < min_offset) {
       min_offset = tag.offset;
     }
+    int read_length = reads->getPhredString(tag.read_id, tag.tissue_type).size();
+    if (read_length > max_read_length) {
+      max_read_length = read_length;
+    }
   }
   // value did not change and will cause std::bad_alloc, so set to 0
   if(min_offset == std::numeric_limits<int>::max()) {
     min_offset = 0;
   }
 
-  vector<string> alignedBlock;
-  vector< vector<int> > cnsCount;
-  for (int n_vectors=0; n_vectors < 4; n_vectors++) {
-    vector<int> v(max_offset + READ_LENGTH - min_offset, 0);
-    cnsCount.push_back(v);
-  }
+  // Pileup. counts holds 4 counters (A, T, C, G) per column, column after
+  // column. Reads are not copied: LEFT reads are walked backwards and
+  // complemented as they are counted.
+  int n_cols = max_offset + max_read_length - min_offset;
+  vector<uint16_t> &counts = scratch.counts;
+  counts.assign(n_cols * 4, 0);
 
   for (read_tag const & tag : subBlock) {
-    string read = reads->getReadByIndex(tag.read_id, tag.tissue_type);
-    string phred = reads->getPhredString(tag.read_id, tag.tissue_type);
+    string const& read = reads->getReadByIndex(tag.read_id, tag.tissue_type);
+    string const& phred = reads->getPhredString(tag.read_id, tag.tissue_type);
+    int len = phred.size();   // read.size() - 1, as phreds have no '$'
+
+    // only allow high quality bases to contribute to consensus
+    qualityMask(phred, scratch.mask);
+    uint8_t const* mask = scratch.mask.data();
+    uint16_t *col = &counts[(max_offset - tag.offset) * 4];
 
     // calibrate for orientation
-    if(tag.orientation == LEFT) {
-      read = reverseComplementString(read);
-      std::reverse(phred.begin(), phred.end());
+    if (tag.orientation == LEFT) {
+      for (int i=0, src=len-1; i < len; i++, src--, col += 4) {
+        uint8_t code = COMP_BASE_CODE[(uint8_t) read[src]];
+        col[code & 3] += mask[src] & (code >> 2);
+      }
     }
     else {
-      read.pop_back();    // remove dollar symbol
-    }
-
-    for(int i=0; i < read.size(); i++) {
-      // only allow high quality bases to contribute to consensus
-      if (phred[i] >= MIN_PHRED_QUAL) {
-        switch(read[i]) {
-          case 'A':
-            cnsCount[0][(max_offset - tag.offset) + i]++; break;
-          case 'T':
-            cnsCount[1][(max_offset - tag.offset) + i]++; break;
-          case 'C':
-            cnsCount[2][(max_offset - tag.offset) + i]++; break;
-          case 'G':
-            cnsCount[3][(max_offset - tag.offset) + i]++; break;
-        }
+      for (int i=0; i < len; i++, col += 4) {
+        uint8_t code = BASE_CODE[(uint8_t) read[i]];
+        col[code & 3] += mask[i] & (code >> 2);
       }
     }
-    alignedBlock.push_back(addGaps(max_offset - tag.offset) + read);
   }
 
-  for (int pos=0; pos < cnsCount[0].size(); pos++) {
+  cns.clear();
+  cns.reserve(n_cols);
+  for (int pos=0; pos < n_cols; pos++) {
+    uint16_t const* col = &counts[pos * 4];
     int maxVal = 0, maxInd = 0;
 
     // find highest freq. base
     for(int base=0; base < 4; base++) {
-      if (cnsCount[base][pos] > maxVal) {
-        maxVal = cnsCount[base][pos];
+      if (col[base] > maxVal) {
+        maxVal = col[base];
         maxInd = base;
       }
     }
-    switch(maxInd) {
-      case 0:
-        cns += "A"; break;
-      case 1:
-        cns += "T"; break;
-      case 2:
-        cns += "C"; break;
-      case 3:
-        cns += "G"; break;
-    }
-  }
-  if (cns.empty()) {
-    /// return something;
+    cns.push_back(CODE_BASE[maxInd]);
   }
   cns_offset = max_offset;
   pair_id = block.id;
-  qual = buildQualityString(cnsCount, cns, tissue);
-  for (int pos=0; pos < cnsCount[0].size(); pos++) {
+  qual = buildQualityString(counts, cns, tissue);
+  for (int pos=0; pos < n_cols; pos++) {
     // mask all positions with reads less than >= GSA2_MCT
-    int nreads=0;
-    for (int base=0; base < 4; base++) {
-      nreads += cnsCount[base][pos];
-    }
+    uint16_t const* col = &counts[pos * 4];
+    int nreads = col[0] + col[1] + col[2] + col[3];
     if (nreads < GSA2_MCT) {
       if (tissue == TUMOUR) {
         qual[pos] = 'X';
@@ -439,22 +647,57 @@ void BranchPointGroups::generateConsensusSequence(bool tissue,
       }
     }
   }
-  //////// DEBUG
-  //std::cout << ((tissue) ? "Healthy" : "Cancer") << " sub-block below" <<
-  //std::endl;
-  //std::cout << "Block id: " << block.id  << std::endl;
-  //for (int i=0; i < alignedBlock.size(); i++) { // SHOW ALIGNED BLOCK
-  //  std::cout << alignedBlock[i]  << ((subBlock[i].orientation == RIGHT) ? ", R" : ", L") 
-  //       << ((subBlock[i].tissue_type == HEALTHY) ? ", (H, ridx:" : 
-  //           ((subBlock[i].tissue_type == SWITCHED) ? ", (S, ridx:" : ", (T, ridx: ")) 
-  //       << subBlock[i].read_id << ")" << std::endl;
-  //}
-  //std::cout << "CONSENSUS AND CNS LEN" <<  cns.size() << std::endl;
-  //std::cout << cns << std::endl << std::endl;
-  //std::cout << "QSTRING" << std::endl;
-  //std::cout << qual << std::endl;
+
+#ifdef DEBUG_CONSENSUS
+  // The aligned block is only built when compiled with -DDEBUG_CONSENSUS
+  vector<string> alignedBlock;
+  for (read_tag const& tag : subBlock) {
+    string read = reads->getReadByIndex(tag.read_id, tag.tissue_type);
+    if (tag.orientation == LEFT) {
+      read = reverseComplementString(read);
+    }
+    else {
+      read.pop_back();    // remove dollar symbol
+    }
+    alignedBlock.push_back(addGaps(max_offset - tag.offset) + read);
+  }
+  std::lock_guard<std::mutex> lock(cout_lock);
+  std::cout << ((tissue) ? "Healthy" : "Cancer") << " sub-block below" <<
+  std::endl;
+  std::cout << "Block id: " << block.id  << std::endl;
+  for (int i=0; i < alignedBlock.size(); i++) { // SHOW ALIGNED BLOCK
+    std::cout << alignedBlock[i]  << ((subBlock[i].orientation == RIGHT) ? ", R" : ", L") 
+         << ((subBlock[i].tissue_type == HEALTHY) ? ", (H, ridx:" : 
+             ((subBlock[i].tissue_type == SWITCHED) ? ", (S, ridx:" : ", (T, ridx: ")) 
+         << subBlock[i].read_id << ")" << std::endl;
+  }
+  std::cout << "CONSENSUS AND CNS LEN" <<  cns.size() << std::endl;
+  std::cout << cns << std::endl << std::endl;
+  std::cout << "QSTRING" << std::endl;
+  std::cout << qual << std::endl;
+#endif
 }
 
+void BranchPointGroups::qualityMask(string const& phred, vector<uint8_t> &mask) {
+  // mask[i] = 1 if phred[i] >= MIN_PHRED_QUAL, else 0
+  int len = phred.size();
+  mask.resize(len);
+  uint8_t const* q = reinterpret_cast<uint8_t const*>(phred.data());
+  int i = 0;
+#ifdef __SSE2__
+  // phred characters are < 128, so a signed byte compare is safe
+  __m128i threshold = _mm_set1_epi8(MIN_PHRED_QUAL - 1);
+  __m128i one = _mm_set1_epi8(1);
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(q + i));
+    __m128i pass = _mm_and_si128(_mm_cmpgt_epi8(v, threshold), one);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&mask[i]), pass);
+  }
+#endif
+  for (; i < len; i++) {
+    mask[i] = (q[i] >= MIN_PHRED_QUAL);
+  }
+}
 
 void BranchPointGroups::outputExtractedCancerReads(std::string const& filename) {
   ofstream ofHandle(filename.c_str());
@@ -481,94 +724,108 @@ BranchPointGroups::~BranchPointGroups() {
 }
 
 void BranchPointGroups::extractCancerSpecificReads() {
-  unsigned int elements_per_thread = (SA->getSize()  / N_THREADS);
-  cout << "Elements per thread" << elements_per_thread << endl;
+  CancerExtraction.resize(reads->getSize(TUMOUR));
+  MemoryTracker::global().set("CancerExtraction", CancerExtraction.bytes());
   cout << "GSA size: " << SA->getSize() << endl;
-  vector<thread> workers;
-  unsigned int from=0, to= elements_per_thread;
-  for(int i=0; i < N_THREADS; i++) {
-    workers.push_back(
-      std::thread(&BranchPointGroups::extractionWorker, 
-        this, from, to)
-    );
-    from = to;
-    if(i == N_THREADS - 2) {
-      to = SA->getSize();
-    }
-    else {
-      to += elements_per_thread;
-    }
-  }
-  for(auto &thread : workers) {
-      thread.join();
-  }
+
+  // Work is divided into chunks that start and end on group boundaries,
+  // so a group is never split between threads. Otherwise a split could 
+  // result in a non-mutated region looking as if it only contains 
+  // cancer reads.
+  ScanScheduler scheduler(SA->getSize(), N_THREADS,
+      [this](unsigned int i) {
+        return ::computeLCP(SA->getElem(i-1), SA->getElem(i), *reads) 
+               < reads->getMinSuffixSize();
+      });
+  cout << "Scan chunks: " << scheduler.numChunks() << endl;
+  vector< vector<sa_interval> > chunk_repeats(scheduler.numChunks());
+  scheduler.run(
+      [this, &chunk_repeats](unsigned int chunk, unsigned int from, 
+                             unsigned int to) {
+        Trace::Span span("extraction chunk", "chunk", chunk);
+        extractionWorker(from, to, chunk_repeats[chunk]);
+      });
+
+  // chunks are in array order, so RepeatIntervals is sorted
+  RepeatIntervals.clear();
+  for (vector<sa_interval> const& repeats : chunk_repeats) {
+    RepeatIntervals.insert(RepeatIntervals.end(), repeats.begin(), 
+                           repeats.end());
+  }
+  cout << "Over threshold groups: " << RepeatIntervals.size() << endl;
 }
 
-unsigned int BranchPointGroups::backUpSearchStart(unsigned int seed_index) {
-  // Thread work division could split a group in half. It is possible
-  // that the split could result in a non-mutated region looking as
-  // if it only contains cancer reads. 
-  if (seed_index == 0) {
-    return seed_index;
-  }
-  unsigned int start_point = seed_index - 1;
-  while (::computeLCP(SA->getElem(start_point), SA->getElem(seed_index),
-        *reads) >= reads->getMinSuffixSize()) {
-    start_point--;
-    if (start_point == 0) break;
-  }
-  return start_point;
+unsigned int BranchPointGroups::countDistinctReads(unsigned int from,
+    unsigned int to) {
+  // reads are distinct as in read_tag_compare: by read_id, and by
+  // tissue class (TUMOUR/SWITCHED vs HEALTHY)
+  vector<unsigned long long> keys;
+  keys.reserve(to - from);
+  for (unsigned int i = from; i < to; i++) {
+    keys.push_back(((unsigned long long) SA->getElem(i).read_id << 1) |
+                   (SA->getElem(i).type % 2));
+  }
+  std::sort(keys.begin(), keys.end());
+  return std::unique(keys.begin(), keys.end()) - keys.begin();
 }
 
-void BranchPointGroups::extractionWorker(unsigned int seed_index, unsigned int to) {
-  set<unsigned int> threadExtr;
-  seed_index = backUpSearchStart(seed_index);
-  unsigned int extension {seed_index + 1};
-  while (seed_index < to && seed_index != SA->getSize() - 1) {   // CONFIRM EFFECT OF THIS
+bool BranchPointGroups::inRepeatInterval(unsigned int sa_index) {
+  // find the last interval starting at or before sa_index
+  vector<sa_interval>::const_iterator it = std::upper_bound(
+      RepeatIntervals.begin(), RepeatIntervals.end(), sa_index,
+      [](unsigned int i, sa_interval const& interval) {
+        return i < interval.from;
+      });
+  if (it == RepeatIntervals.begin()) {
+    return false;
+  }
+  --it;
+  return sa_index < it->to;
+}
+
+void BranchPointGroups::extractionWorker(unsigned int seed_index, unsigned int to,
+    vector<sa_interval> &repeats) {
+  // [seed_index, to) starts and ends on group boundaries
+  while (seed_index < to) {
     double c_reads{0}, h_reads{0};    // reset counts
 
     // Assuming that a > 2 group will form, start counting from seed_index
     if (SA->getElem(seed_index).type == HEALTHY) h_reads++;
     else c_reads++;
 
-    while (::computeLCP(SA->getElem(seed_index), SA->getElem(extension), *reads)
+    unsigned int extension {seed_index + 1};
+    while (extension < to &&
+           ::computeLCP(SA->getElem(seed_index), SA->getElem(extension), *reads)
         >= reads->getMinSuffixSize()) {
       // tally tissue types of group
       if(SA->getElem(extension).type == HEALTHY) h_reads++;
       else c_reads++;
       extension++;
-      if (extension == SA->getSize()) break;    // bound check GSA
     }
     // Group size == 1 and group sizes of 1 permitted and groups is cancer read
     if (extension - seed_index == 1 && GSA1_MCT   == 1 && SA->getElem(seed_index).type == TUMOUR) {
-      threadExtr.insert(SA->getElem(seed_index).read_id);           // extract read
+      CancerExtraction.atomicSet(SA->getElem(seed_index).read_id);  // extract read
     }
     else if (c_reads >= GSA1_MCT  && (h_reads / c_reads) <= ECONT)  {
       for (unsigned int i = seed_index; i < extension; i++) {
         if (SA->getElem(i).type == TUMOUR) {
-          threadExtr.insert(SA->getElem(i).read_id);
+          CancerExtraction.atomicSet(SA->getElem(i).read_id);
         }
       }
     }
-    seed_index = extension++; 
-  }
 
-  // On very rare cases, the very last value in the GSA is unique. 
-  // In such a case, this value will not have been analysed 
-  // by the loop. In these cases, seed_index == SA.size()-1, rather
-  // than SA.size() - which is the case if the extension proceeds to the
-  // end.  Therefore, if the case condition is true, we need to check
-  // it separately.
-  if (seed_index == SA->getSize() -1) {
-    if (GSA1_MCT  == 1 && SA->getElem(seed_index).type == TUMOUR) {
-      threadExtr.insert(SA->getElem(seed_index).read_id);
+    // Extending from any member of a group adds every read of the group
+    // but the seed to the block. Record groups that would put a block
+    // over the coverage threshold on their own.
+    const unsigned int repeat_size = COVERAGE_UPPER_THRESHOLD + 1;
+    if (extension - seed_index > repeat_size &&
+        countDistinctReads(seed_index, extension) > repeat_size) {
+      sa_interval repeat;
+      repeat.from = seed_index;
+      repeat.to = extension;
+      repeats.push_back(repeat);
     }
-  }
-
-  // Load to CancerExtraction, avoiding thread interference
-  std::lock_guard<std::mutex> lock(cancer_extraction_lock);
-  for(unsigned int extracted_cancer_read : threadExtr) {
-      CancerExtraction.insert(extracted_cancer_read);
+    seed_index = extension; 
   }
 }
 
@@ -653,30 +910,52 @@ void BranchPointGroups::extractionWorker(unsigned int seed_index, unsigned int t
 //}
 
 void BranchPointGroups::seedBreakPointBlocks() {
+  cout << "Cancer Extraction size: " <<  CancerExtraction.count() << endl;
+  if (CancerExtraction.empty()) {
+    return;
+  }
+
+  // Reusing GSA1 costs a linear scan over the whole of GSA1, sorting
+  // costs a radix sort plus a binary search per forward suffix. Reuse 
+  // GSA1 unless the forward suffixes are few in comparison. 
+  unsigned long long forward_bases = 0;
+  for (unsigned int read_id : CancerExtraction) {
+    forward_bases += reads->getReadByIndex(read_id, TUMOUR).size();
+  }
+
+  vector<read_tag> gsa;
+  if (forward_bases * GSA1_SCAN_FACTOR >= SA->getSize()) {
+    mergeConstructGSA2(gsa);
+  }
+  else {
+    radixConstructGSA2(gsa);
+  }
+
+  //// PRINT gsa
+  //for (read_tag const& tag : gsa) {
+  //  std::cout << readTagToString(tag) 
+  //            << ((tag.orientation) ? " -- R" : " -- L") << endl;
+  //}
+
+  MemoryTracker::global().set("GSA2", MemoryTracker::vectorBytes(gsa));
+
+  cout << "Extracting groups from cancer specific gsa" << endl;
+  extractGroups(gsa);
+  MemoryTracker::global().set("SeedBlocks", seedBlocksBytes());
+  MemoryTracker::global().release("GSA2");
+}
 
+void BranchPointGroups::radixConstructGSA2(vector<read_tag> &gsa) {
   string concat("");
   vector<pair<unsigned int, unsigned int>> binary_search_array;
 
-  // load the first element
-  set<unsigned int>::iterator it = CancerExtraction.begin();
-  pair<unsigned int, unsigned int> first_read(*it,0);
-  binary_search_array.push_back(first_read);    // first read starts at zero
-  concat += reads->getReadByIndex(*it, TUMOUR);
-  concat += reverseComplementString( 
-      reads->getReadByIndex(*it, TUMOUR)
-  ) + "$";
-
-  cout << "Cancer Extraction size: " <<  CancerExtraction.size() << endl;
-  unsigned int concat_idx = 0;
-  it++;
-  for (; it != CancerExtraction.end(); it++) {
-    // build concat
-    concat += reads->getReadByIndex(*it, TUMOUR);
-    concat += reverseComplementString(reads->getReadByIndex(*it, TUMOUR)) + "$";
-    // add bsa values
-    concat_idx += reads->getReadByIndex(*std::prev(it), TUMOUR).size() * 2;
-    pair<unsigned int, unsigned int> read_concat_pair (*it, concat_idx);
+  for (unsigned int read_id : CancerExtraction) {
+    // add bsa values, each read starts where the previous one ended
+    pair<unsigned int, unsigned int> read_concat_pair(read_id, concat.size());
     binary_search_array.push_back(read_concat_pair);
+    // build concat
+    concat += reads->getReadByIndex(read_id, TUMOUR);
+    concat += reverseComplementString(reads->getReadByIndex(read_id, TUMOUR)) + "$";
   }
 
   // Build SA
@@ -685,25 +964,127 @@ void BranchPointGroups::seedBreakPointBlocks() {
     Radix<unsigned long long>((uchar*) concat.c_str(), concat.size()).build();
   cout << "Size of cancer specific sa: " << concat.size() << endl;
 
-
   cout << "Transforming to cancer specfic gsa" << endl;
+  transformRadixGSA2(radixSA, concat.size(), binary_search_array, true, gsa);
+  delete [] radixSA;
+}
 
-  // transform to GSA
-  vector<read_tag> gsa;
-  for (unsigned long long i=0; i < concat.size(); i++) {
+void BranchPointGroups::mergeConstructGSA2(vector<read_tag> &gsa) {
+  // Forward suffixes: GSA1 holds every suffix of every tumour read
+  // that is longer than the minimum suffix size, already sorted.
+  cout << "Filtering cancer specific forward suffixes from GSA1" << endl;
+  // Every position is a boundary, so chunks are plain index ranges.
+  // Each chunk filters into its own vector, concatenated in chunk order.
+  ScanScheduler scheduler(SA->getSize(), N_THREADS, 
+      [](unsigned int i) { return true; });
+  vector< vector<read_tag> > chunk_forward(scheduler.numChunks());
+  scheduler.run(
+      [this, &chunk_forward](unsigned int chunk, unsigned int from,
+                             unsigned int to) {
+        vector<read_tag> &local = chunk_forward[chunk];
+        for (unsigned int i=from; i < to; i++) {
+          Suffix_t const& suf = SA->getElem(i);
+          if (suf.type == TUMOUR && CancerExtraction.test(suf.read_id)) {
+            read_tag tag;
+            tag.read_id = suf.read_id;
+            tag.orientation = RIGHT;
+            tag.offset = suf.offset;
+            tag.tissue_type = TUMOUR;
+            local.push_back(tag);
+          }
+        }
+      });
+  vector<read_tag> forward;
+  concatChunks(chunk_forward, forward);
+
+  // Reverse complement suffixes: sort these alone
+  string concat("");
+  vector<pair<unsigned int, unsigned int>> binary_search_array;
+  for (unsigned int read_id : CancerExtraction) {
+    pair<unsigned int, unsigned int> read_concat_pair(read_id, concat.size());
+    binary_search_array.push_back(read_concat_pair);
+    concat += reverseComplementString(reads->getReadByIndex(read_id, TUMOUR)) + "$";
+  }
+  cout << "Building cancer specific reverse complement sa" << endl;
+  unsigned long long *radixSA = 
+    Radix<unsigned long long>((uchar*) concat.c_str(), concat.size()).build();
+  cout << "Size of cancer specific reverse complement sa: " 
+       << concat.size() << endl;
+  vector<read_tag> reverse;
+  transformRadixGSA2(radixSA, concat.size(), binary_search_array, false, reverse);
+  delete [] radixSA;
+
+  // merge the two sorted runs
+  cout << "Merging forward and reverse complement suffixes" << endl;
+  gsa.reserve(forward.size() + reverse.size());
+  unsigned int f = 0, r = 0;
+  while (f < forward.size() && r < reverse.size()) {
+    if (lexCompare(reverse[r], forward[f])) {
+      gsa.push_back(reverse[r++]);
+    }
+    else {
+      gsa.push_back(forward[f++]);
+    }
+  }
+  gsa.insert(gsa.end(), forward.begin() + f, forward.end());
+  gsa.insert(gsa.end(), reverse.begin() + r, reverse.end());
+}
+
+void BranchPointGroups::transformRadixGSA2(unsigned long long const* radixSA,
+    unsigned long long size, vector<pair<unsigned int, unsigned int> > &bsa,
+    bool concat_holds_forward, vector<read_tag> &gsa) {
+
+  // transform to GSA. Chunks are plain index ranges, transformed into
+  // their own vectors and concatenated in chunk order.
+  ScanScheduler scheduler(size, N_THREADS, 
+      [](unsigned int i) { return true; });
+  vector< vector<read_tag> > chunk_gsa(scheduler.numChunks());
+  scheduler.run(
+      [&, this](unsigned int chunk, unsigned int from, unsigned int to) {
+        Trace::Span span("GSA2 transform chunk", "chunk", chunk);
+        transformRadixGSA2Range(radixSA, from, to, bsa, concat_holds_forward,
+                                chunk_gsa[chunk]);
+      });
+  concatChunks(chunk_gsa, gsa);
+}
+
+void BranchPointGroups::concatChunks(vector< vector<read_tag> > &chunks,
+    vector<read_tag> &out) {
+  unsigned long long total = out.size();
+  for (vector<read_tag> const& chunk : chunks) {
+    total += chunk.size();
+  }
+  out.reserve(total);
+  for (vector<read_tag> &chunk : chunks) {
+    out.insert(out.end(), chunk.begin(), chunk.end());
+    vector<read_tag>().swap(chunk);
+  }
+}
+
+void BranchPointGroups::transformRadixGSA2Range(
+    unsigned long long const* radixSA, unsigned int from, unsigned int to,
+    vector<pair<unsigned int, unsigned int> > &bsa,
+    bool concat_holds_forward, vector<read_tag> &gsa) {
+  for (unsigned int i=from; i < to; i++) {
     pair <unsigned int, unsigned int> read_concat_pair = 
-      SA->binarySearch(binary_search_array, radixSA[i]);
+      SA->binarySearch(bsa, radixSA[i]);
 
     unsigned int offset = radixSA[i] - read_concat_pair.second;
-    int read_size = reads->getReadByIndex(read_concat_pair.first, TUMOUR).size();
+    unsigned int read_size = 
+      reads->getReadByIndex(read_concat_pair.first, TUMOUR).size();
 
     bool orientation = RIGHT;
-    if (offset >= read_size) {
+    if (!concat_holds_forward) {
+      orientation = LEFT;
+    }
+    else if (offset >= read_size) {
       orientation = LEFT;
       offset -= read_size;
     }
     // remove suffixes that are too short
-    if (read_size - offset <= reads->getMinSuffixSize())  continue;
+    if (read_size - offset <= (unsigned int) reads->getMinSuffixSize()) {
+      continue;
+    }
 
     // read is stored in forward orientation, convert if LEFT
     if (orientation == LEFT) {
@@ -717,17 +1098,16 @@ void BranchPointGroups::seedBreakPointBlocks() {
     tag.tissue_type = TUMOUR;
     gsa.push_back(tag);       // gsa should be built
   } 
+}
 
-  cout << "Extracting groups from cancer specific gsa" << endl;
-  delete [] radixSA;
-
-  //// PRINT gsa
-  //for (read_tag const& tag : gsa) {
-  //  std::cout << readTagToString(tag) 
-  //            << ((tag.orientation) ? " -- R" : " -- L") << endl;
-  //}
-
-  extractGroups(gsa);
+bool BranchPointGroups::lexCompare(read_tag const& a, read_tag const& b) {
+  read_tag_view a_view = tagView(a);
+  read_tag_view b_view = tagView(b);
+  int lcp = computeLCP(a, b);
+  if (lcp == a_view.length || lcp == b_view.length) {
+    return a_view.length < b_view.length;   // prefix is smaller
+  }
+  return a_view[lcp] < b_view[lcp];
 }
 
 string BranchPointGroups::readTagToString(read_tag const& tag) {
@@ -742,13 +1122,34 @@ string BranchPointGroups::readTagToString(read_tag const& tag) {
   return read.substr(offset) + dollar;
 }
 
+read_tag_view BranchPointGroups::tagView(read_tag const& tag) {
+  string const& read = reads->getReadByIndex(tag.read_id, tag.tissue_type);
+  read_tag_view view;
+  view.read = read.data();
+  view.orientation = tag.orientation;
+  if (tag.orientation == RIGHT) {
+    view.start = tag.offset;
+    view.length = read.size() - tag.offset;
+  }
+  else {
+    // equivalent to readTagToString(): reverse complement (dropping '$'),
+    // substr from read.size() - (offset + min_suffix + 1), then add '$'
+    view.start = tag.offset + reads->getMinSuffixSize() - 1;
+    view.length = view.start + 2;
+  }
+  return view;
+}
+
 int BranchPointGroups::computeLCP(read_tag const& a, read_tag const& b) {
-  string a_str = readTagToString(a);
-  string b_str = readTagToString(b);
+  read_tag_view a_view = tagView(a);
+  read_tag_view b_view = tagView(b);
+  if (a.orientation == RIGHT && b.orientation == RIGHT) {
+    return lcpKernel(a_view.read + a_view.start, a_view.length,
+                     b_view.read + b_view.start, b_view.length);
+  }
+  int n = (a_view.length < b_view.length) ? a_view.length : b_view.length;
   int lcp = 0;
-  while (lcp < a_str.length() &&
-         lcp < b_str.length() &&
-         a_str[lcp] == b_str[lcp]) lcp++;
+  while (lcp < n && a_view[lcp] == b_view[lcp]) lcp++;
   return lcp;
 }
 
@@ -767,43 +1168,55 @@ char BranchPointGroups::revCompCharacter(char ch, bool rc) {
 
 //// New version: Takes into account CTR and does not have rare case bug
 void BranchPointGroups::extractGroups(vector<read_tag> const& gsa) {
-  // Adding from, to parameters, in order to make logic compatible
-  // with later multithreading modifications.
-  unsigned int to{gsa.size()}, seed_index{0};
-  unsigned int extension{seed_index + 1};
-  unsigned int block_id;
-
-  // < to is thread safe, != gsa.size() - 1 is rare case bound safe
-  while (seed_index < to && seed_index != gsa.size() - 1) {
-    bp_block block;
+  // Chunks start and end on group boundaries, so each group is
+  // extracted by exactly one thread.
+  ScanScheduler scheduler(gsa.size(), N_THREADS,
+      [this, &gsa](unsigned int i) {
+        return computeLCP(gsa[i-1], gsa[i]) < reads->getMinSuffixSize();
+      });
+  vector< vector<bp_block> > chunk_blocks(scheduler.numChunks());
+  scheduler.run(
+      [this, &gsa, &chunk_blocks](unsigned int chunk, unsigned int from,
+                                  unsigned int to) {
+        Trace::Span span("group chunk", "chunk", chunk);
+        extractGroups(gsa, from, to, chunk_blocks[chunk]);
+      });
+
+  // block ids follow GSA2 order: a prefix sum of the block counts
+  // of the preceding chunks
+  unsigned int block_id{0};
+  unsigned int n_blocks{0};
+  for (vector<bp_block> const& blocks : chunk_blocks) {
+    n_blocks += blocks.size();
+  }
+  SeedBlocks.reserve(SeedBlocks.size() + n_blocks);
+  for (vector<bp_block> &blocks : chunk_blocks) {
+    for (bp_block &block : blocks) {
+      block.id = block_id++;
+      SeedBlocks.push_back(std::move(block));
+    }
+    vector<bp_block>().swap(blocks);
+  }
+}
+
+void BranchPointGroups::extractGroups(vector<read_tag> const& gsa,
+    unsigned int seed_index, unsigned int to, vector<bp_block> &blocks) {
+  // [seed_index, to) starts and ends on group boundaries
+  while (seed_index < to) {
     // compute group size - avoid inserting here to avoid unnecessary mallocs
-    while (computeLCP(gsa[seed_index], gsa[extension]) >= reads->getMinSuffixSize()) {
+    unsigned int extension{seed_index + 1};
+    while (extension < to && 
+           computeLCP(gsa[seed_index], gsa[extension]) >= reads->getMinSuffixSize()) {
       extension++;
-      if (extension == gsa.size()) break;
     }
     // Make alloc if group at or above CTR
     if (extension - seed_index >= GSA2_MCT) {
-      for (int i=seed_index; i < extension; i++) block.block.insert(gsa[i]); 
-    }
-    else {    // continue, discarding group
-      seed_index = extension++;
-      continue;
+      bp_block block;
+      for (unsigned int i=seed_index; i < extension; i++) block.insert(gsa[i]); 
+      //BlockSeeds.push_back(block);     // for loss of sensitivity by way of 2
+      blocks.push_back(std::move(block));
     }
-  
-    // Load group into break point blocks
-    block.id = block_id;
-    //BlockSeeds.push_back(block);     // for loss of sensitivity by way of 2
-    SeedBlocks.push_back(block);
-    block_id++;
-    seed_index = extension++;
-  }
-
-  if (seed_index == gsa.size() - 1 && GSA2_MCT == 1) {
-    bp_block block;
-    block.block.insert(gsa[seed_index]);
-    block.id = block_id;
-    //BlockSeeds.push_back(block);      // for loss of sensitivity by way of 2
-    SeedBlocks.push_back(block);
+    seed_index = extension;
   }
 }
 
@@ -906,15 +1319,16 @@ void BranchPointGroups::extractNonMutatedAlleles() {
     long long int fwd_index = binarySearch(read);
     long long int rev_index = binarySearch(rev_read);
 
+    bool over_threshold{false};
     if (fwd_index != -1) {
-      extendBlock(fwd_index, block.block, tag.orientation, 0);
+      extendBlock(fwd_index, block, tag.orientation, 0, over_threshold);
     }
     else {
       //std::cout << "Search failed" << std::endl;
     }
 
     if (rev_index != -1) {
-      extendBlock(rev_index, block.block, !tag.orientation, 0);
+      extendBlock(rev_index, block, !tag.orientation, 0, over_threshold);
     }
     else {
       //std::cout << "Search failed" << std::endl;
@@ -1199,6 +1613,38 @@ string BranchPointGroups::buildQualityString(vector< vector<int> > const& freq_m
 }
 
 
+string BranchPointGroups::buildQualityString(vector<uint16_t> const& counts,
+    string const& cns, bool tissue) {
+  // As buildQualityString() above, over a flat pileup of 4 counters
+  // per column. Flat pileups have no invalidated columns, so column
+  // pos corresponds to cns[pos].
+  const int n_cols = cns.size();
+  string q_str(n_cols, '-');
+  for (int pos=0; pos < n_cols; pos++) {
+    uint16_t const* col = &counts[pos * 4];
+
+    double total_bases = col[0] + col[1] + col[2] + col[3];
+    int n_bases_above_err_freq{0};
+    for(int base=0; base < 4; base++) {
+      if((col[base] / total_bases) > ALLELIC_FREQ_OF_ERROR) {
+        n_bases_above_err_freq++;
+      }
+    }
+    if (n_bases_above_err_freq > 1) { // then mask
+      q_str[pos] = 'L';
+      continue;
+    }
+
+    // Unique masking logic to cancer reads
+    // The supporting evidence for the chosen consensus
+    // position must be above 4
+    if (tissue == TUMOUR && col[BASE_CODE[(uint8_t) cns[pos]] & 3] < GSA2_MCT) {
+      q_str[pos] = 'L';
+    }
+  }
+  return q_str;
+}
+
 string BranchPointGroups::addGaps(int n_gaps) {
   string gaps = "";
 
@@ -1217,12 +1663,20 @@ void BranchPointGroups::invalidatePosition(vector< vector<int> > &alignment_coun
 
 
 bool BranchPointGroups::extendBlock(int seed_index, 
-    set<read_tag, read_tag_compare> &block, bool orientation, int calibration) {
+    bp_block &block, bool orientation, int calibration,
+    bool &over_threshold) {
 
   // seed_index is the index of the unique suffix_t this function
   // was called with. 
   bool success_left{false}, success_right{false};
 
+  // the group of a repeat locus would push the block over the threshold
+  // no matter what else it holds, so do not scan it
+  if (inRepeatInterval(seed_index)) {
+    over_threshold = true;
+    return false;
+  }
+
   int left_of_seed = 0, right_of_seed = 0;
 
   if (seed_index != 0){
@@ -1237,17 +1691,21 @@ bool BranchPointGroups::extendBlock(int seed_index,
 
 
   if (left_of_seed >= 30 && seed_index > 0){
-    success_left = getSuffixesFromLeft(seed_index, block, orientation, calibration);
+    success_left = getSuffixesFromLeft(seed_index, block, orientation,
+        calibration, over_threshold);
   }
   
-  if (right_of_seed >= 30 && seed_index < (SA->getSize() - 1)) {
-    success_right = getSuffixesFromRight(seed_index, block, orientation, calibration);
+  if (right_of_seed >= 30 && seed_index < (SA->getSize() - 1) &&
+      !over_threshold) {
+    success_right = getSuffixesFromRight(seed_index, block, orientation,
+        calibration, over_threshold);
   }
   return success_left || success_right;
 }
 
 bool BranchPointGroups::getSuffixesFromLeft(int seed_index,
-  set<read_tag, read_tag_compare> &block, bool orientation, int calibration) {
+    bp_block &block, bool orientation, int calibration,
+    bool &over_threshold) {
 
   bool success = false;
   int left_arrow = seed_index-1;
@@ -1279,18 +1737,22 @@ bool BranchPointGroups::getSuffixesFromLeft(int seed_index,
     else {    // we need to switch the type of TUMOUR to SWITCHED
       next_read.tissue_type = SWITCHED;
     }
+    OpCounters::add(OP_SUFFIXES_VISITED);
 
     // insert tag into block
-    std::pair<set<read_tag, read_tag_compare>::iterator, bool> 
-      insertion = block.insert(next_read);
-    if (insertion.second == true) success = true;
+    if (block.insert(next_read)) success = true;
+    if (block.size() > COVERAGE_UPPER_THRESHOLD) {
+      over_threshold = true;
+      break;
+    }
     left_arrow--;
   }
   return success;
 }
 
 bool BranchPointGroups::getSuffixesFromRight(int seed_index,
-    set<read_tag, read_tag_compare> &block, bool orientation, int calibration) {
+    bp_block &block, bool orientation, int calibration,
+    bool &over_threshold) {
 
   bool success = false;
   int right_arrow = seed_index+1;
@@ -1321,10 +1783,13 @@ bool BranchPointGroups::getSuffixesFromRight(int seed_index,
     else {    // we need to switch the type of TUMOUR to SWITCHED
       next_read.tissue_type = SWITCHED;
     }
+    OpCounters::add(OP_SUFFIXES_VISITED);
 
-    std::pair<set<read_tag, read_tag_compare>::iterator, bool> 
-      insertion = block.insert(next_read);
-    if (insertion.second == true) success = true;
+    if (block.insert(next_read)) success = true;
+    if (block.size() > COVERAGE_UPPER_THRESHOLD) {
+      over_threshold = true;
+      break;
+    }
     right_arrow++;
   }
   return success;
@@ -1374,10 +1839,12 @@ long long int BranchPointGroups::binarySearch(string query) {
   lcp_left_query = lcp(reads->returnSuffix(SA->getElem(left)), query, 0);
   lcp_right_query = lcp(reads->returnSuffix(SA->getElem(right)), query, 0);
   min_left_right = minVal(lcp_left_query, lcp_right_query);
+  OpCounters::add(OP_SA_SEARCHES);
 
   while (left <= right) {
     bool left_shift{false};
     mid = (left + right) / 2;
+    OpCounters::add(OP_SEARCH_PROBES);
     if(lcp(reads->returnSuffix(SA->getElem(mid)), query,  min_left_right) == query.size()) {
       // 30bp stretch covered. Arrived at genomic location. Return.
       return mid; // backUpToFirstMatch(mid, query);
@@ -1408,11 +1875,12 @@ long long int BranchPointGroups::binarySearch(string query) {
   return -1; // no match
 }
 
-int BranchPointGroups::lcp(string l, string r, unsigned int mlr) {
-  while (mlr < l.length() && mlr < r.length() && l[mlr] == r[mlr]) {
-    mlr++;
+int BranchPointGroups::lcp(string const& l, string const& r, unsigned int mlr) {
+  if (mlr >= l.length() || mlr >= r.length()) {
+    return mlr;
   }
-  return mlr;
+  return mlr + lcpKernel(l.data() + mlr, l.length() - mlr,
+                         r.data() + mlr, r.length() - mlr);
 }
 
 long long int BranchPointGroups::backUpToFirstMatch(long long int bs_hit, string query) {
@@ -1428,10 +1896,10 @@ long long int BranchPointGroups::backUpToFirstMatch(long long int bs_hit, string
 }
 
 void BranchPointGroups::mergeBlocks(bp_block & to, bp_block & from) {
-  set<read_tag, read_tag_compare>::iterator f_it = from.block.begin();
-  set<read_tag, read_tag_compare>::iterator common_read;
+  vector<read_tag>::iterator f_it = from.block.begin();
+  read_tag *common_read;
   // Find read in common between blocks.
-  for(; (common_read = to.block.find(*f_it)) == to.block.end(); f_it++);
+  for(; (common_read = to.find(*f_it)) == nullptr; f_it++);
 
   // The orientation associated with each read, is its aligning orientation
   // relative to its current block. At this moment in time, the final
@@ -1440,7 +1908,7 @@ void BranchPointGroups::mergeBlocks(bp_block & to, bp_block & from) {
   // in the from and to block, the orientations of each read in the
   // from block needs to be switched.
   if (common_read->orientation != f_it->orientation) {
-    for(set<read_tag, read_tag_compare>::iterator it = from.block.begin();
+    for(vector<read_tag>::iterator it = from.block.begin();
         it != from.block.end(); it++) {
       if (it->orientation == LEFT) {
         it->orientation = RIGHT;
@@ -1485,7 +1953,7 @@ void BranchPointGroups::mergeBlocks(bp_block & to, bp_block & from) {
   //  }
   //  to.insert(*it);
   //}
-  for (set<read_tag, read_tag_compare>::iterator it = from.block.begin();
+  for (vector<read_tag>::iterator it = from.block.begin();
        it != from.block.end();
        it++) {
     if (it->orientation == RIGHT) {
@@ -1528,7 +1996,7 @@ void BranchPointGroups::unifyBlocks(vector<bp_block> & seedBlocks) {
   unsigned int min = std::numeric_limits<unsigned int>::max();
   unsigned int max = 0;
   for (bp_block const& b : seedBlocks) {      // find global min/max
-    for (set<read_tag, read_tag_compare>::const_iterator block_it = b.block.begin();
+    for (vector<read_tag>::const_iterator block_it = b.block.begin();
         block_it != b.block.end();
         block_it++) {
       if (block_it->read_id < min) {
@@ -1587,6 +2055,10 @@ unsigned int BranchPointGroups::getSize() {
   return BreakPointBlocks.size();
 }
 
+unsigned int BranchPointGroups::nSeedBlocks() {
+  return SeedBlocks.size();
+}
+
 consensus_pair & BranchPointGroups::getPair(int i) {
   return consensus_pairs[i];
 }
@@ -1595,7 +2067,7 @@ int BranchPointGroups::cnsPairSize() {
   return consensus_pairs.size();
 }
 void BranchPointGroups::printAlignedBlock(bp_block block) {
-  if (block.block.size() > COVERAGE_UPPER_THRESHOLD || block.block.empty()) return;
+  if (block.size() > COVERAGE_UPPER_THRESHOLD || block.empty()) return;
   int max = std::numeric_limits<int>::min();
 
   for (read_tag tag : block.block) {
@@ -2955,7 +3427,7 @@ void BranchPointGroups::printAlignedBlocks() {
 //}
 
 void BranchPointGroups::makeBreakPointBlocks(){
-  if(CancerExtraction.size() == 0) {
+  if(CancerExtraction.empty()) {
     cout << "No mutations were identified " << endl;
     exit(1);
   }
@@ -8,10 +8,15 @@
 #include <set>      // contain reads
 #include <utility>  // need coordinates to define read index, bool
 #include <mutex>
+#include <atomic>
+#include <functional>
+#include <stdint.h>
 
 #include "util_funcs.h"
 #include "Suffix_t.h"
 #include "SuffixArray.h"
+#include "ReadBitmap.h"
+#include "BlockingQueue.h"
 
 // a read_tag is extracted for each read in a break ppoint
 // block determining now the read aligns to the other
@@ -23,59 +28,115 @@ struct read_tag{
   int tissue_type;
 };
 
-struct read_tag_compare{
-  // this functor only compares the read id from hashtag
-  // the other data is considered metadata that I can use later
-
-  bool operator() (const read_tag &a, const read_tag &b) const {
-
-    // the comparison needs to avoid adding duplicate reads.
-    // duplicate reads will have the same read_id val, and
-    // derive from the same data set, either H,H or T,S.
-    // As such, when comparisons between H,T and H,S are made,
-    // it is perfectly valid for both elems to have same read_id val
-    // this comparison allows for this
-    if( (a.tissue_type == TUMOUR || a.tissue_type == SWITCHED) &&
-        (b.tissue_type == TUMOUR || b.tissue_type == SWITCHED) ) {
-        return a.read_id < b.read_id;
-    }
-    else if (a.tissue_type == HEALTHY && b.tissue_type == HEALTHY) {
-        return a.read_id < b.read_id;
-    }
-    else {
-        return (a.tissue_type % 2) < (b.tissue_type % 2); // mod to keep SWITCHED and TUMOUR together
-    }
+// a read_tag_view yields the suffix a read_tag represents, base by
+// base, directly from the read store. RIGHT tags index the stored read.
+// LEFT tags walk the stored read backwards, complementing each base, and
+// finish with the '$' that the reverse complement suffix carries. 
+// No copy of the read is made.
+struct read_tag_view {
+  char const* read;   // stored read (RIGHT orientation), '$' terminated
+  int start;          // index in read of the first suffix character
+  int length;         // suffix length, including '$'
+  bool orientation;
+
+  char operator[](int i) const {
+    if (orientation == RIGHT) return read[start + i];
+    if (i == length - 1) return '$';
+    return complementBase(read[start - i]);
   }
 };
 
-
-
 // Moved the break point blocks from vector<set<read_tag, read_tag_compare>>
 // to a struct, allowing a block id to carried with each break point block
 // this is used for development purposes and will be redundant
 // once the algorithm has been developed
 
 struct bp_block {
-  std::set<read_tag, read_tag_compare> block;
+  // A set of read_tags, with at most one tag per read of each tissue
+  // class. TUMOUR and SWITCHED tags are one class, HEALTHY the other, so
+  // a tumour read can be held once as TUMOUR or SWITCHED, and a healthy
+  // read once as HEALTHY. The first tag inserted for a read is kept.
+  // Tags are stored flat, in insertion order. Small blocks are searched
+  // linearly; larger blocks build an open addressed index over block.
+  std::vector<read_tag> block;
   unsigned int id;
 
-  // wrap insert func to avoid refactoring
-  void insert(read_tag r) {
-    block.insert(r);
-  }
+  bp_block(): id(0) {}
+
+  bool insert(read_tag const& r);
+  // Adds r unless the block holds a tag of the same read and tissue
+  // class. Returns true if r was added
+
+  read_tag * find(read_tag const& r);
+  // returns the tag of the same read and tissue class as r, or nullptr
 
-  int size() {
+  int size() const {
     return block.size();
   }
 
+  bool empty() const {
+    return block.empty();
+  }
+
   void clear() {
+    // keeps allocated capacity, so a block reused for many blocks
+    // stops allocating once it has grown to the largest
     block.clear();
+    index.clear();
+    id = 0;
+  }
+
+  void release() {
+    // frees all memory held by the block
+    std::vector<read_tag>().swap(block);
+    std::vector<unsigned int>().swap(index);
     id = 0;
   }
+
+  size_t bytes() const {
+    // returns the number of bytes allocated by the block
+    return block.capacity() * sizeof(read_tag) + 
+           index.capacity() * sizeof(unsigned int);
+  }
+
+private:
+  std::vector<unsigned int> index;
+  // index slots hold a position in block + 1, or 0 if empty. Only
+  // built once block passes LINEAR_SEARCH_MAX tags
+
+  static const unsigned int LINEAR_SEARCH_MAX = 32;
+
+  static unsigned long long key(read_tag const& r) {
+    return ((unsigned long long) r.read_id << 1) | (r.tissue_type % 2);
+  }
+  unsigned int slot(unsigned long long k) const {
+    return (k * 0x9E3779B97F4A7C15ULL) >> 32 & (index.size() - 1);
+  }
+  int findPosition(unsigned long long k, unsigned int &s) const;
+  void rebuildIndex(unsigned int n_slots);
+};
+
+// A half open range [from, to) of GSA1 indices
+struct sa_interval {
+  unsigned int from;
+  unsigned int to;
+};
+
+// Working buffers of one consensus thread. They are reused for every
+// block the thread processes, so capacity built up for one block is 
+// not freed and reallocated for the next.
+struct consensus_scratch {
+  bp_block block;                 // seed block, as it is extended
+  std::vector<read_tag> sub_block;
+  std::vector<uint16_t> counts;   // flat pileup, 4 counters per column
+  std::vector<uint8_t> mask;      // quality mask of the current read
 };
 
 
 class BranchPointGroups {
+  friend class KernelBenchmarks;
+  friend class PipelineTests;
+
 private:
   const char MIN_PHRED_QUAL;
   const int GSA1_MCT;
@@ -86,28 +147,30 @@ private:
   const double ECONT;
   const double ALLELIC_FREQ_OF_ERROR;
 
-  std::mutex cancer_extraction_lock;
   std::mutex cout_lock;
 
   ReadsManipulator *reads;
   SuffixArray *SA;    // store a pointer to SA for access
 
-  std::set<unsigned int> CancerExtraction;
-  // CancerExtraction contains sets of ints, where each set
-  // covers some mutation that was gathered, and the ints represent
-  // the read_id that covered the mutation. 
+  ReadBitmap CancerExtraction;
+  // CancerExtraction has a bit set for the read_id of each tumour
+  // read that covered some mutation that was gathered. 
   // CancerExtraction is used as a storage container, that is
   // used to unify reads that cover the same mutation and are
   // in the same orientation. This is done by unifyComplementaryGroups()
   // The unified groups are then stored in ComplementaryUnified
 
+  std::vector<sa_interval> RepeatIntervals;
+  // RepeatIntervals holds the GSA1 groups (suffixes sharing a 30bp
+  // prefix) with more distinct reads than COVERAGE_UPPER_THRESHOLD + 1.
+  // Sorted, and filled during extractCancerSpecificReads()
+
   std::vector<bp_block> SeedBlocks;  // only contain tumour read subblock
   std::vector<bp_block> BreakPointBlocks;
   std::vector<consensus_pair> consensus_pairs;
   
 
   void makeBreakPointBlocks();
-  unsigned int backUpSearchStart(unsigned int seed_index);
   
 
   void extractCancerSpecificReads();
@@ -119,18 +182,36 @@ private:
 
 
 
+  void extractionWorker(unsigned int from, unsigned int to,
+                        std::vector<sa_interval> &repeats);
+  // Extracts the cancer specific groups in SA[from, to), and appends
+  // the groups over the coverage threshold to repeats. from and to
+  // must be group boundaries.
+
+  unsigned int countDistinctReads(unsigned int from, unsigned int to);
+  // returns the number of reads in SA[from, to) that a bp_block would
+  // hold as distinct
+
+  bool inRepeatInterval(unsigned int sa_index);
+  // returns true if sa_index lies in one of RepeatIntervals
+
   bool getSuffixesFromLeft(int seed_index, 
-                           std::set<read_tag, read_tag_compare> &block,
-                           bool orientation, int calibration);
+                           bp_block &block,
+                           bool orientation, int calibration,
+                           bool &over_threshold);
   // Function gathers suffixes from left (towards 0) in the array
-  // that share an lcp of >= 30 with the suffix at SA[seed_index]
+  // that share an lcp of >= 30 with the suffix at SA[seed_index].
+  // Stops, setting over_threshold, once the block holds more than
+  // COVERAGE_UPPER_THRESHOLD reads
   
   
   bool getSuffixesFromRight(int seed_index, 
-                           std::set<read_tag, read_tag_compare> &block, 
-                           bool orientation, int calibration);
+                           bp_block &block, 
+                           bool orientation, int calibration,
+                           bool &over_threshold);
   // Function gathers suffixes from right (towards end) in the array
-  // that share an lcp of >= 30 with the suffix at SA[seed_index]
+  // that share an lcp of >= 30 with the suffix at SA[seed_index].
+  // Stops as getSuffixesFromLeft() does
 
   // Function called directly by makeReadGroup if max LCP is between seed
   // and seed + 1 in LCP. Adds all the suffixes indcies 
@@ -143,10 +224,41 @@ private:
   // looping through each block and searching for each 30bp substring
   // of each read
 
-  void extractNonMutatedAlleles(bp_block &block, consensus_pair &pair);
-
-  bool extendBlock(int seed_index, std::set<read_tag, read_tag_compare> 
-      &block, bool orientation, int calibration);
+  bool extractNonMutatedAlleles(bp_block &block, consensus_pair &pair);
+  // Extends block with the reads covering the non mutated allele of pair.
+  // Returns false if the block went over COVERAGE_UPPER_THRESHOLD
+
+  void buildConsensusBatch(unsigned int batch, 
+      std::vector<consensus_pair> *results, std::vector<char> *accepted,
+      consensus_scratch &scratch);
+  // Task function of buildConsensusPairs(). Builds the pairs of the seed
+  // blocks of batch, then emits the batches that are ready
+
+  void emitBatches(unsigned int batch, std::vector<consensus_pair> *results,
+      std::vector<char> *accepted);
+  // Marks batch as built, then emits the accepted pairs of every built
+  // batch not preceded by an unbuilt one, in block order
+
+  size_t seedBlocksBytes() const;
+  // bytes allocated by SeedBlocks and its blocks
+  static size_t pairBytes(consensus_pair const& pair);
+  // bytes allocated by the sequences and qualities of pair
+
+  std::mutex emit_lock;
+  std::vector<char> batch_done;
+  unsigned int emit_batch;    // first batch not yet emitted
+  int n_skipped;
+  BlockingQueue<consensus_pair> *pair_stream;
+  std::function<void(unsigned int)> before_consensus_batch;
+  // if set, called with each batch before it is built. Lets tests make
+  // a consensus task fail
+
+  bool buildConsensusPair(bp_block &block, consensus_pair &pair,
+      consensus_scratch &scratch);
+  // Generates the tumour and healthy consensus of block, then trims and
+  // masks them. Returns false if the block is rejected
+
+  bool extendBlock(int seed_index, bp_block &block, bool orientation, int calibration, bool &over_threshold);
   // Once a read covering a mutated allele
   // has been found, extract reads with >= 30bp lcp in common with seed_index
 
@@ -155,7 +267,7 @@ private:
   // However, to avoid redundant comps, comparison starts from 
   // position min_lr
 
-  int lcp(std::string l, std::string r, unsigned int mlr);
+  int lcp(std::string const& l, std::string const& r, unsigned int mlr);
   // avoid redund comps with mlr
 
   int minVal(int a, int b);
@@ -172,8 +284,6 @@ private:
   // Once binarySearch() finds the match, it calls backUpToFirstMatch()
   // which finds the smallest indexed suffix that matches the query
 
-  void extractionWorker(unsigned int to, unsigned int from);
-
   void invalidatePosition(std::vector< std::vector<int> > &alignment_counter, 
       int pos);
   // Where number of reads is < TRIM_VALUE this sets bases rows at the
@@ -185,11 +295,50 @@ private:
   // Output: Loads the groups of cancer specific reads into BreakPointBlocks
   // Details: Uses a GSA in order to group the reads. Groups are formed
   // from reads contiguous in the array that have LCP >= 30
+  void radixConstructGSA2(std::vector<read_tag> &gsa);
+  // Builds GSA2 by radix sorting the concatenation of every extracted 
+  // cancer read and its reverse complement.
+
+  void mergeConstructGSA2(std::vector<read_tag> &gsa);
+  // Builds GSA2 by reusing GSA1: the forward suffixes of the extracted 
+  // reads are already sorted in GSA1, so they are filtered out in order.
+  // Only the reverse complement suffixes are radix sorted, and the two
+  // sorted runs are then merged.
+
+  void transformRadixGSA2(unsigned long long const* radixSA,
+      unsigned long long size,
+      std::vector<std::pair<unsigned int, unsigned int> > &bsa, 
+      bool concat_holds_forward, std::vector<read_tag> &gsa);
+  // Transforms the radixSA of a GSA2 concatenation into read_tags. If
+  // concat_holds_forward each read in the concatenation is followed by 
+  // its reverse complement, otherwise only reverse complements are held.
+  // Ranges of radixSA are transformed in parallel.
+
+  void transformRadixGSA2Range(unsigned long long const* radixSA,
+      unsigned int from, unsigned int to,
+      std::vector<std::pair<unsigned int, unsigned int> > &bsa,
+      bool concat_holds_forward, std::vector<read_tag> &gsa);
+  // Transforms radixSA[from, to), appending the read_tags to gsa
+
+  void concatChunks(std::vector< std::vector<read_tag> > &chunks,
+      std::vector<read_tag> &out);
+  // Appends chunks to out in order, freeing each chunk
+
+  bool lexCompare(read_tag const& a, read_tag const& b);
+  // returns true if the suffix represented by a is lexicographically
+  // smaller than the suffix represented by b
+
   void extractGroups(std::vector<read_tag> const& gsa);
   // Input: GSA of cancer specific reads
-  // Output: BreakPointBlocks with loaded blocks
+  // Output: SeedBlocks with loaded blocks
   // Details: Forms the groups of contiguous reads with LCP >= 30 
-  // using seed and extension 
+  // using seed and extension. Groups are formed in parallel, then
+  // numbered in GSA2 order, so block ids do not depend on thread count.
+
+  void extractGroups(std::vector<read_tag> const& gsa, unsigned int from,
+      unsigned int to, std::vector<bp_block> &blocks);
+  // Forms the groups of gsa[from, to), appending those of at least
+  // GSA2_MCT reads to blocks. from and to must be group boundaries.
 
   std::string buildQualityString(std::vector<std::vector<int> > const&
       freq_matrix, std::string const& cns, bool tissue);
@@ -202,7 +351,20 @@ private:
   //  -- Health: if the number of bases with frequency above the error threshold
   //             (ALLELIC_ERROR_THRESH) is > 1 then mask
 
+  std::string buildQualityString(std::vector<uint16_t> const& counts,
+      std::string const& cns, bool tissue);
+  // As above, for the flat pileup built by generateConsensusSequence()
+
+  void qualityMask(std::string const& phred, std::vector<uint8_t> &mask);
+  // Sets mask[i] to 1 where phred[i] >= MIN_PHRED_QUAL, 0 otherwise.
+  // Compares 16 phred characters per step where SSE2 is available.
+
   int computeLCP(read_tag const& a, read_tag const& b);
+  // Returns the lcp of the suffixes represented by a and b. Compares
+  // through read_tag_views so no strings are built.
+
+  read_tag_view tagView(read_tag const& tag);
+  // Returns a view of the suffix represented by tag
 
   char revCompCharacter(char ch, bool rc);
 
@@ -229,8 +391,17 @@ public:
                     int coverage_upper_threshold,
                     int n_threads, int max_low_confidence_pos,
                     double econt, double allelic_freq_of_error);
-  // Construtor: Uses SA to load data. Constructor called 
-  // generateReadGroups, and so, the object is functional after this call
+  // Construtor: Uses SA to load data. Constructor extracts the cancer 
+  // specific reads and seeds the break point blocks. Consensus pairs are
+  // then built by buildConsensusPairs()
+
+  void buildConsensusPairs(int n_threads, 
+      BlockingQueue<consensus_pair> *stream = nullptr);
+  // Builds a consensus pair for each seed block, at most n_threads
+  // blocks at once,
+  // loading accepted pairs into consensus_pairs in pair_id order. If
+  // given, each accepted pair is also pushed to stream as soon as all
+  // earlier pairs are, and stream is closed once all are built
 
   ~BranchPointGroups();
   // Destructor dealocates BPG
@@ -238,6 +409,9 @@ public:
   unsigned int getSize();
   // returns size of BreakPointBlocks
 
+  unsigned int nSeedBlocks();
+  // returns the number of seed blocks
+
   std::string reverseComplementString(std::string s);
   // returns the reverse complement of a string
 
@@ -256,7 +430,8 @@ public:
   // block_id
 
   void generateConsensusSequence(bool tissue, bp_block const& block, int &
-      cns_offset, unsigned int & pair_id, std::string & cns, std::string & qual);
+      cns_offset, unsigned int & pair_id, std::string & cns, std::string & qual,
+      consensus_scratch & scratch);
 
   std::string addGaps(int ngaps);
   // Function returns a string of lenth ngaps, where gaps are '-'
@@ -0,0 +1,191 @@
+// BwaAligner.cpp
+#include <string>
+#include <vector>
+#include <climits>
+#include <cstdlib>
+#include <stdexcept>
+#include <iostream>
+
+#include "BwaAligner.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+using namespace std;
+
+// bwa mem internals. Not exported by bwamem.h, but used by
+// bwamem_extra.c in the same way.
+extern "C" {
+  mem_alnreg_v mem_align1_core(const mem_opt_t *opt, const bwt_t *bwt,
+                               const bntseq_t *bns, const uint8_t *pac,
+                               int l_seq, char *seq, void *buf);
+  int mem_mark_primary_se(const mem_opt_t *opt, int n, mem_alnreg_t *a,
+                          int64_t id);
+  // smem_aux_t, the SMEM scratch mem_align1_core() takes as buf, is
+  // opaque outside bwamem.c
+  void *smem_aux_init();
+  void smem_aux_destroy(void *a);
+}
+
+struct smem_buffer {
+  // One worker's SMEM scratch, reused across its queries as
+  // mem_process_seqs() does, instead of mem_align1_core() allocating
+  // and freeing one per query
+  void *aux;
+  smem_buffer(): aux(smem_aux_init()) {}
+  ~smem_buffer() { smem_aux_destroy(aux); }
+  smem_buffer(smem_buffer const&) = delete;
+  smem_buffer & operator=(smem_buffer const&) = delete;
+};
+
+static const unsigned int QUERIES_PER_TASK = 256;
+static const int SUPPLEMENTARY_FLAG = 0x800;
+static const int SECONDARY_FLAG = 0x100;
+static const int UNMAPPED_FLAG = 0x4;
+static const int REVERSE_FLAG = 0x10;
+static const int BAM_CSOFT_CLIP = 3;
+static const int BAM_CHARD_CLIP = 4;
+
+BwaAligner::BwaAligner(string const& index_prefix) {
+  cout << "Loading bwa index " << index_prefix << endl;
+  idx = bwa_idx_load(index_prefix.c_str(), BWA_IDX_ALL);
+  if (idx == NULL) {
+    throw runtime_error("could not load bwa index " + index_prefix);
+  }
+  opt = mem_opt_init();
+}
+
+BwaAligner::~BwaAligner() {
+  free(opt);
+  bwa_idx_destroy(idx);
+}
+
+vector<bwa_record> BwaAligner::align(vector<string> const& queries,
+                                     int n_threads) {
+  // Each task aligns a contiguous run of queries into its own slot,
+  // so concatenating the slots keeps the input order.
+  unsigned int n_tasks = (queries.size() + QUERIES_PER_TASK - 1) /
+                         QUERIES_PER_TASK;
+  vector< vector<bwa_record> > task_records(n_tasks);
+  WorkerLocal<smem_buffer> buffers(ThreadPool::global());
+  ThreadPool::global().parallelFor(n_tasks,
+      [this, &queries, &task_records, &buffers](unsigned int t) {
+    unsigned int from = t * QUERIES_PER_TASK;
+    unsigned int to = min<size_t>(from + QUERIES_PER_TASK, queries.size());
+    Trace::Span span("bwa align", "task", t);
+    void *aux = buffers.local().aux;
+    for (unsigned int q = from; q < to; q++) {
+      alignOne(queries[q], q, aux, task_records[t]);
+    }
+  }, n_threads);
+
+  vector<bwa_record> records;
+  records.reserve(queries.size());
+  for (vector<bwa_record> &task : task_records) {
+    for (bwa_record &r : task) {
+      records.push_back(std::move(r));
+    }
+  }
+  return records;
+}
+
+void BwaAligner::alignOne(string const& seq, unsigned int query, void *aux,
+                          vector<bwa_record> &records) {
+  // mem_align1_core() encodes the sequence in place
+  string encoded(seq);
+  mem_alnreg_v regs = mem_align1_core(opt, idx->bwt, idx->bns, idx->pac,
+                                      encoded.size(), &encoded[0], aux);
+  mem_mark_primary_se(opt, regs.n, regs.a, query);
+
+  // As mem_reg2sam(): keep primary hits scoring at least opt->T. Hits
+  // after the first are supplementary, with mapq no higher than the
+  // first.
+  int n_out = 0, first_mapq = 0;
+  for (size_t k = 0; k < regs.n; k++) {
+    mem_alnreg_t *p = &regs.a[k];
+    if (p->score < opt->T) continue;
+    if (p->secondary >= 0 && (p->is_alt || !(opt->flag & MEM_F_ALL))) {
+      continue;
+    }
+    if (p->secondary >= 0 && p->secondary < INT_MAX &&
+        p->score < regs.a[p->secondary].score * opt->drop_ratio) {
+      continue;
+    }
+    mem_aln_t aln = mem_reg2aln(opt, idx->bns, idx->pac, encoded.size(),
+                                encoded.c_str(), p);
+    bool supplementary = n_out > 0 && p->secondary < 0;
+    if (supplementary) aln.flag |= SUPPLEMENTARY_FLAG;
+    if (n_out == 0) first_mapq = aln.mapq;
+    else if (!p->is_alt && aln.mapq > first_mapq) aln.mapq = first_mapq;
+
+    bwa_record r;
+    r.query = query;
+    r.flag = aln.flag | (aln.is_rev ? REVERSE_FLAG : 0);
+    r.rname = idx->bns->anns[aln.rid].name;
+    r.pos = aln.pos + 1;
+    r.mapq = aln.mapq;
+    r.cigar = cigarString(aln, n_out > 0);
+    if (!(aln.flag & SECONDARY_FLAG)) {
+      r.seq = aln.is_rev ? reverseComplement(seq) : seq;
+      // hard clipped bases are not part of SEQ
+      if (n_out > 0 && aln.n_cigar > 0 && !(opt->flag & MEM_F_SOFTCLIP) &&
+          !aln.is_alt) {
+        int head = aln.cigar[0] & 0xf, tail = aln.cigar[aln.n_cigar-1] & 0xf;
+        int qe = r.seq.size();
+        if (tail == BAM_CSOFT_CLIP || tail == BAM_CHARD_CLIP) {
+          qe -= aln.cigar[aln.n_cigar-1] >> 4;
+        }
+        r.seq.erase(qe);
+        if (head == BAM_CSOFT_CLIP || head == BAM_CHARD_CLIP) {
+          r.seq.erase(0, aln.cigar[0] >> 4);
+        }
+      }
+    }
+    else {
+      r.seq = "*";
+    }
+    free(aln.cigar);
+    records.push_back(r);
+    n_out++;
+  }
+  free(regs.a);
+
+  if (n_out == 0) {       // no alignment good enough, record unmapped
+    bwa_record r;
+    r.query = query;
+    r.flag = UNMAPPED_FLAG;
+    r.rname = "*";
+    r.pos = 0;
+    r.mapq = 0;
+    r.cigar = "*";
+    r.seq = seq;
+    records.push_back(r);
+  }
+}
+
+string BwaAligner::cigarString(mem_aln_t const& aln, bool supplementary) {
+  string cigar;
+  for (int i = 0; i < aln.n_cigar; i++) {
+    int op = aln.cigar[i] & 0xf;
+    if (!(opt->flag & MEM_F_SOFTCLIP) && !aln.is_alt &&
+        (op == BAM_CSOFT_CLIP || op == BAM_CHARD_CLIP)) {
+      op = supplementary ? BAM_CHARD_CLIP : BAM_CSOFT_CLIP;
+    }
+    cigar += to_string(aln.cigar[i] >> 4);
+    cigar += "MIDSH"[op];
+  }
+  return cigar.empty() ? "*" : cigar;
+}
+
+string BwaAligner::reverseComplement(string const& seq) {
+  string rc(seq.rbegin(), seq.rend());
+  for (char &c : rc) {
+    switch (c) {
+      case 'A': c = 'T'; break;
+      case 'C': c = 'G'; break;
+      case 'G': c = 'C'; break;
+      case 'T': c = 'A'; break;
+      default:  c = 'N';
+    }
+  }
+  return rc;
+}
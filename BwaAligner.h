@@ -0,0 +1,58 @@
+#ifndef BWAALIGNER_H
+#define BWAALIGNER_H
+
+#include <string>
+#include <vector>
+
+#include "bwa/bwa.h"
+#include "bwa/bwamem.h"
+#include "BranchPointGroups.h"
+
+struct bwa_record {
+  unsigned int query;   // index of the aligned sequence in the input
+  int flag;             // SAM FLAG
+  std::string rname;    // "*" when unmapped
+  int pos;              // 1-based leftmost position, 0 when unmapped
+  int mapq;
+  std::string cigar;    // "*" when unmapped
+  std::string seq;      // query as written to SAM (reverse complemented
+                        // when the alignment is on the reverse strand)
+};
+
+class BwaAligner {
+  // Aligns consensus sequences to the reference in process with
+  // the vendored bwa mem library. The index is loaded once, by
+  // the constructor, and shared by all the alignment threads.
+
+private:
+  bwaidx_t *idx;
+  mem_opt_t *opt;
+
+  void alignOne(std::string const& seq, unsigned int query, void *aux,
+                std::vector<bwa_record> &records);
+  // Aligns seq, appending to records the alignments bwa mem would
+  // write to a SAM file for a single end read: the primary, any
+  // supplementary alignments, or one unmapped record. query is the
+  // index of seq in the input, also used to break ties between equal
+  // best hits, as bwa mem does with the read index. aux is the calling
+  // worker's bwa SMEM scratch, from smem_aux_init().
+
+  std::string cigarString(mem_aln_t const& aln, bool supplementary);
+  // Formats the bam encoded cigar of aln. Clips are hard clips for
+  // supplementary alignments
+
+  std::string reverseComplement(std::string const& seq);
+
+public:
+  BwaAligner(std::string const& index_prefix);
+  // Loads the bwa index (.bwt, .sa, .pac, .ann, .amb) with basename
+  // index_prefix. Throws runtime_error if it cannot be loaded.
+  ~BwaAligner();
+
+  std::vector<bwa_record> align(std::vector<std::string> const& queries,
+                                int n_threads);
+  // Aligns each query on the global thread pool, using at most
+  // n_threads workers. Records are returned in the order of queries,
+  // with query set to the index of the query.
+};
+#endif
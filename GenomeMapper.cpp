@@ -5,7 +5,20 @@
 #include <string>
 #include <fstream>
 #include <cstdlib>
-#include <boost/regex.hpp>
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+#include <cctype>
+#include <exception>
+#include <stdexcept>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "GenomeMapper.h"
 #include "BranchPointGroups.h"
@@ -13,7 +26,13 @@
 #include "util_funcs.h"
 #include "string.h"
 #include "SamEntry.h"
+#include "BlockingQueue.h"
+#include "BwaAligner.h"
 #include "benchmark.h"
+#include "ThreadPool.h"
+#include "Metrics.h"
+#include "MemoryTracker.h"
+#include "Trace.h"
 
 using namespace std;
 
@@ -30,45 +49,309 @@ static const int MUT_CNS = 1;
 
 
 
+static const string BOWTIE2 = "./bowtie2-2.3.1/bowtie2";
+static const size_t PIPE_BUFFER_SIZE = 1 << 16;
+static const size_t SAM_CHUNK_SIZE = 1 << 23;
+
 static const int REVERSE_FLAG = 16;
 static const int FORWARD_FLAG = 0;
 
 
+static bool writeAll(int fd, string const& data) {
+  // write() may take less than all of data, or be interrupted
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t n = write(fd, data.data() + done, data.size() - done);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
 GenomeMapper::GenomeMapper(BranchPointGroups &bpgroups, 
                            ReadsManipulator &reads,
                            string outpath,
                            string const& basename,
-                           string const& chr,
+                           vector<string> const& chromosomes,
+                           bool split_output,
                            string const& bwt_idx,
                            int min_mapq):
                            MIN_MAPQ(min_mapq),
-                           CHR(chr) {
+                           CHROMOSOMES(chromosomes),
+                           SPLIT_OUTPUT(split_output),
+                           BWT_IDX(bwt_idx),
+                           aligned_in_memory(false),
+                           n_aligned(0),
+                           n_called(0) {
 
   this->reads = &reads;
   this->BPG = &bpgroups;
   if (outpath[outpath.size()-1] != '/') outpath += "/";
-  string fastqName(outpath + basename + ".fastq"),
-         samName(outpath + basename + ".sam"),
-         outName(outpath + basename + ".SNV_results");
+  fastqName = outpath + basename + ".fastq";
+  samName = outpath + basename + ".sam";
+  outName = outpath + basename + ".SNV_results";
+  outPrefix = outpath + basename;
+}
 
+void GenomeMapper::writeFastq(BlockingQueue<consensus_pair> &pairs) {
 //  buildConsensusPairs();
   cout << "Writing fastq" << endl;
-  constructSNVFastqData(fastqName);
+  constructSNVFastqData(pairs, fastqName);
+}
+
+void GenomeMapper::alignFastq(int n_threads) {
   cout << "Aligning consensus pairs with Bowtie2" << endl;
 
   // Call Bowtie2
-  string command_aln("./bowtie2-2.3.1/bowtie2 -x " + bwt_idx + " -U " +
+  // A sam left by an earlier run must not be parsed if Bowtie2 fails
+  string command_aln(BOWTIE2 + " -p " + to_string(n_threads) +
+                     " -x " + BWT_IDX + " -U " +
                      fastqName + " -S " + samName);
-  system(command_aln.c_str());
+  remove(samName.c_str());
+  int status = system(command_aln.c_str());
+  if (status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    throw runtime_error("Bowtie2 failed (" + BOWTIE2 + ")");
+  }
+}
+
+void GenomeMapper::alignStreaming(BlockingQueue<consensus_pair> &pairs,
+                                  int n_threads) {
+  cout << "Aligning consensus pairs with Bowtie2 over pipes" << endl;
+
+  // to_aligner carries fastq to Bowtie2's stdin, from_aligner carries
+  // sam from its stdout. All ends are close-on-exec, so Bowtie2 only
+  // keeps the two it is given as stdin and stdout.
+  int to_aligner[2], from_aligner[2];
+  if (pipe2(to_aligner, O_CLOEXEC) != 0) {
+    throw runtime_error(string("pipe to Bowtie2: ") + strerror(errno));
+  }
+  if (pipe2(from_aligner, O_CLOEXEC) != 0) {
+    close(to_aligner[0]);
+    close(to_aligner[1]);
+    throw runtime_error(string("pipe from Bowtie2: ") + strerror(errno));
+  }
+
+  // argv is built before fork(), as the child of a threaded process
+  // may only make async-signal-safe calls before exec
+  vector<string> args = {BOWTIE2, "-p", to_string(n_threads),
+                         "-x", BWT_IDX, "-U", "-"};
+  vector<char*> argv;
+  for (string &a : args) argv.push_back(&a[0]);
+  argv.push_back(NULL);
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    for (int fd : {to_aligner[0], to_aligner[1],
+                   from_aligner[0], from_aligner[1]}) {
+      close(fd);
+    }
+    throw runtime_error(string("fork Bowtie2: ") + strerror(errno));
+  }
+  if (pid == 0) {
+    dup2(to_aligner[0], STDIN_FILENO);
+    dup2(from_aligner[1], STDOUT_FILENO);
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+  close(to_aligner[0]);
+  close(from_aligner[1]);
+
+  exception_ptr writer_error;
+  int stage = Metrics::currentStage();
+  thread writer([this, &pairs, &to_aligner, &writer_error, stage]() {
+    // If Bowtie2 dies, writes to it fail with EPIPE rather than
+    // killing GeDi. SIGPIPE goes to the writing thread, so blocking it
+    // here leaves the rest of the process, and Bowtie2, untouched
+    sigset_t sigpipe;
+    sigemptyset(&sigpipe);
+    sigaddset(&sigpipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigpipe, NULL);
+    Metrics::enterStage(stage);
+    Trace::nameThread("bowtie2 writer");
+    try {
+      feedAligner(pairs, to_aligner[1]);
+    }
+    catch (...) {
+      writer_error = current_exception();
+    }
+  });
+
+  try {
+    readSam(from_aligner[0], n_threads);
+  }
+  catch (...) {
+    close(from_aligner[0]);
+    writer.join();
+    waitpid(pid, NULL, 0);
+    throw;
+  }
+  close(from_aligner[0]);
+  writer.join();
+
+  int status;
+  {
+    Trace::Span span("aligner wait");
+    waitpid(pid, &status, 0);
+  }
+  // A failed Bowtie2 also breaks the pipe, so report it first
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    throw runtime_error("Bowtie2 failed (" + BOWTIE2 + ")");
+  }
+  if (writer_error) {
+    rethrow_exception(writer_error);
+  }
+  aligned_in_memory = true;
+}
 
-  vector<SamEntry> alignments;
-  cout << "Parsing sam" << endl;
-  parseSamFile(alignments, samName);
-  cout << "Identifying SNV" << endl;
-  identifySNVs(alignments);
+void GenomeMapper::feedAligner(BlockingQueue<consensus_pair> &pairs, int fd) {
+  // Records are written in PIPE_BUFFER_SIZE batches. On a write error
+  // the remaining pairs are still drained, so the producer is not held
+  // up, and the error is reported once the queue is closed.
+  string buffer;
+  string error;
+  consensus_pair cns_pair;
+  while (pairs.pop(cns_pair)) {
+    if (!error.empty() ||
+        cns_pair.mutated.empty() || cns_pair.non_mutated.empty()) {
+      continue;
+    }
+    buffer += fastqRecord(cns_pair);
+    n_aligned++;
+    if (buffer.size() < PIPE_BUFFER_SIZE) {
+      continue;
+    }
+    Trace::Span span("aligner write", "bytes", buffer.size());
+    if (!writeAll(fd, buffer)) {
+      error = strerror(errno);
+    }
+    buffer.clear();
+  }
+  if (error.empty() && !writeAll(fd, buffer)) {
+    error = strerror(errno);
+  }
+  close(fd);
+  if (!error.empty()) {
+    throw runtime_error("writing to Bowtie2: " + error);
+  }
+}
+
+void GenomeMapper::alignInMemory(BlockingQueue<consensus_pair> &pairs,
+                                 BwaAligner &aligner, int n_threads) {
+  // Only the aligned sequence and the pair_id are kept: BPG holds
+  // the pairs themselves
+  vector<string> queries;
+  vector<unsigned int> pair_ids;
+  consensus_pair cns_pair;
+  while (pairs.pop(cns_pair)) {
+    if (cns_pair.mutated.empty() || cns_pair.non_mutated.empty()) {
+      continue;
+    }
+    queries.push_back(std::move(cns_pair.non_mutated));
+    pair_ids.push_back(cns_pair.pair_id);
+    n_aligned++;
+  }
+  MemoryTracker::global().set("bwa queries",
+      MemoryTracker::stringsBytes(queries) +
+      MemoryTracker::vectorBytes(pair_ids));
+
+  cout << "Aligning consensus pairs with bwa" << endl;
+  bwa_records = aligner.align(queries, n_threads);
+  queries = vector<string>();
+  MemoryTracker::global().set("bwa queries",
+                              MemoryTracker::vectorBytes(pair_ids));
+  size_t record_bytes = MemoryTracker::vectorBytes(bwa_records);
+  for (bwa_record const& r : bwa_records) {
+    record_bytes += MemoryTracker::stringBytes(r.rname) +
+                    MemoryTracker::stringBytes(r.cigar) +
+                    MemoryTracker::stringBytes(r.seq);
+  }
+  MemoryTracker::global().set("bwa records", record_bytes);
+  for (bwa_record const& r : bwa_records) {
+    if (!passesFilter(r.rname, r.mapq)) {
+      continue;
+    }
+    alignments.push_back(samEntryFromRecord(r, pair_ids[r.query]));
+  }
+  MemoryTracker::global().release("bwa queries");
+  aligned_in_memory = true;
+}
+
+SamEntry GenomeMapper::samEntryFromRecord(bwa_record const& r,
+                                          unsigned int pair_id) {
+  // Same fields as parsing the sam line of the fastq record written
+  // for pair by constructSNVFastqData(). The views point into r, so
+  // it must outlive the entry.
+  SamEntry entry;
+  entry.flag = r.flag;
+  entry.rname = sam_view(r.rname);
+  entry.pos = r.pos;
+  entry.mapq = r.mapq;
+  entry.cigar = sam_view(r.cigar);
+  entry.seq = sam_view(r.seq);
+  entry.pair_id = pair_id;
+  return entry;
+}
+
+void GenomeMapper::callSNVs(int n_threads) {
+  if (!aligned_in_memory) {
+    cout << "Parsing sam" << endl;
+    parseSamFile(samName, n_threads);
+  }
+  indexConsensusPairs();
+  vector<string> chr_names;
+  vector< vector<SamEntry> > chr_alignments;
+  n_called = alignments.size();
+  partitionByChromosome(chr_names, chr_alignments);
+
+  // chromosomes share nothing but the (read only) pair table
+  cout << "Identifying SNV on " << chr_names.size() << " chromosomes" << endl;
+  vector< vector<single_snv> > chr_snvs(chr_names.size());
+  ThreadPool::global().parallelFor(chr_names.size(), 
+      [this, &chr_alignments, &chr_snvs](unsigned int c) {
+    identifySNVs(chr_alignments[c]);
+    collectSNVs(chr_alignments[c], chr_snvs[c]);
+  }, n_threads);
 
 //  printAlignmentStructs(alignments);
-  outputSNVToUser(alignments, outName);
+  if (SPLIT_OUTPUT) {
+    for (unsigned int c = 0; c < chr_names.size(); c++) {
+      outputSNVToUser(chr_snvs[c], 
+                      outPrefix + "." + chr_names[c] + ".SNV_results");
+    }
+  }
+  else {
+    vector<single_snv> snvs;
+    for (vector<single_snv> &chr : chr_snvs) {
+      snvs.insert(snvs.end(), chr.begin(), chr.end());
+    }
+    outputSNVToUser(snvs, outName);
+  }
+}
+
+void GenomeMapper::partitionByChromosome(vector<string> &chr_names,
+    vector< vector<SamEntry> > &chr_alignments) {
+  unordered_map<string, unsigned int> slot;
+  for (string const& chr : CHROMOSOMES) {
+    if (slot.insert(make_pair(chr, chr_names.size())).second) {
+      chr_names.push_back(chr);
+    }
+  }
+  chr_alignments.resize(chr_names.size());
+  for (SamEntry &entry : alignments) {
+    string rname = entry.rname.str();
+    auto it = slot.find(rname);
+    if (it == slot.end()) {
+      it = slot.insert(make_pair(rname, chr_names.size())).first;
+      chr_names.push_back(rname);
+      chr_alignments.push_back(vector<SamEntry>());
+    }
+    chr_alignments[it->second].push_back(std::move(entry));
+  }
+  alignments.clear();
+  alignments.shrink_to_fit();
 }
 
 //void GenomeMapper::callBowtie2() {
@@ -314,20 +597,22 @@ void GenomeMapper::printMutation(char healthy, char cancer, ofstream &mut_file)
 
 void GenomeMapper::printAlignmentStructs(vector<SamEntry> &alignments) {
   for (SamEntry &entry: alignments) {
+    consensus_pair const* pair = findPair(entry);
+    if (pair == nullptr) continue;
     cout << "Cancer seq:" << endl;
-    if(entry.get<int>(SamEntry::FLAG) == FORWARD_FLAG) {
-      printGaps(entry.get<int>(SamEntry::LEFT_OHANG));
+    if(entry.flag == FORWARD_FLAG) {
+      printGaps(pair->left_ohang);
     }
     else {
-      printGaps(entry.get<int>(SamEntry::RIGHT_OHANG));
+      printGaps(pair->right_ohang);
     }
 
-    cout << entry.get<string>(SamEntry::HDR) << endl;
+    cout << orientedMutated(entry, *pair) << endl;
     cout << "Healthy seq:" << endl;
-    cout << entry.get<string>(SamEntry::SEQ) << endl;
-    cout << "Left ohang:  " << entry.get<int>(SamEntry::LEFT_OHANG) << endl;
-    cout << "Right ohang: " << entry.get<int>(SamEntry::RIGHT_OHANG) << endl;
-    cout << "Pair id: " << entry.get<int>(SamEntry::BLOCK_ID) << endl;
+    cout << entry.seq.str() << endl;
+    cout << "Left ohang:  " << pair->left_ohang << endl;
+    cout << "Right ohang: " << pair->right_ohang << endl;
+    cout << "Pair id: " << entry.pair_id << endl;
     for(int i = 0; i < entry.snvLocSize(); i++) {
       cout << entry.snvLocation(i) << ", ";
     }
@@ -358,12 +643,13 @@ void GenomeMapper::printConsensusPairs() {
 }
 
 
-void GenomeMapper::constructSNVFastqData(string const& fastqName) {
+void GenomeMapper::constructSNVFastqData(
+    BlockingQueue<consensus_pair> &pairs, string const& fastqName) {
   ofstream snv_fq;
   snv_fq.open(fastqName.c_str());
 
-  for (int i = 0; i < BPG->cnsPairSize(); i++) {
-    consensus_pair &cns_pair = BPG->getPair(i);
+  consensus_pair cns_pair;
+  while (pairs.pop(cns_pair)) {
     if (cns_pair.mutated.empty() || cns_pair.non_mutated.empty()) {
       continue;
     }
@@ -372,51 +658,112 @@ void GenomeMapper::constructSNVFastqData(string const& fastqName) {
 //    }
     
     // otherwise, write healthy consensus as a fastq
-    // with the SNVs stored in the header parse string
+    // named by its pair_id
     
-    snv_fq << "@" + cns_pair.mutated + 
-    "[" + to_string(cns_pair.left_ohang) + ";" + 
-    to_string(cns_pair.right_ohang) + ";" + 
-    to_string(cns_pair.pair_id) + "]" << endl;
-
-    snv_fq << cns_pair.non_mutated << endl;
-    snv_fq << "+" << endl;
-    string qual(cns_pair.non_mutated.size(), '!'); 
-    snv_fq << qual << endl;
+    snv_fq << fastqRecord(cns_pair);
+    n_aligned++;
   }
 }
 
+string GenomeMapper::fastqRecord(consensus_pair const& cns_pair) {
+  string qual(cns_pair.non_mutated.size(), '!'); 
+  return "@" + to_string(cns_pair.pair_id) + "\n" +
+    cns_pair.non_mutated + "\n" +
+    "+\n" +
+    qual + "\n";
+}
 
 
-void GenomeMapper::parseSamFile(vector<SamEntry> &alignments, string filename) {
-  ifstream snv_sam(filename);	// open alignment file
-  
-  boost::regex rgx_header("(@).*");
-  string line;
-  while(getline(snv_sam, line)) {
 
-    if (boost::regex_match(line, rgx_header)) {	// skip past headers
-      continue;
+void GenomeMapper::parseSamFile(string filename, int n_threads) {
+  int fd = open(filename.c_str(), O_RDONLY);	// open alignment file
+  if (fd < 0) {
+    throw runtime_error("cannot open " + filename + ": " + strerror(errno));
+  }
+  try {
+    readSam(fd, n_threads);
+  }
+  catch (...) {
+    close(fd);
+    throw;
+  }
+  close(fd);
+}
+
+void GenomeMapper::readSam(int fd, int n_threads) {
+  // The sam is read in chunks of about SAM_CHUNK_SIZE, cut after the
+  // last whole line. Each chunk is parsed in parallel, then kept in
+  // sam_buffers, as the alignments parsed from it point into it.
+  SamEntry::filter_fn keep = [this](sam_view const& rname, int mapq) {
+    return passesFilter(rname, mapq);
+  };
+  vector<char> chunk;
+  chunk.reserve(SAM_CHUNK_SIZE);
+  bool eof = false;
+  while (!eof) {
+    if (chunk.size() == chunk.capacity()) {   // line longer than a chunk
+      chunk.reserve(chunk.capacity() * 2);
     }
-   
-    SamEntry entry(line);     // parse the entry into a SamEntry
-    if (entry.get<string>(SamEntry::RNAME) != CHR) {
-      continue;
+    size_t have = chunk.size();
+    chunk.resize(chunk.capacity());
+    ssize_t n;
+    {
+      Trace::Span span("aligner read");
+      n = read(fd, &chunk[have], chunk.size() - have);
     }
-    if(entry.get<int>(SamEntry::MAPQ) < MIN_MAPQ) {
+    if (n < 0) {
+      chunk.resize(have);
+      if (errno == EINTR) continue;
+      throw runtime_error(string("reading sam: ") + strerror(errno));
+    }
+    chunk.resize(have + n);
+    eof = (n == 0);
+    if (!eof && chunk.size() < chunk.capacity()) {
       continue;
     }
-    alignments.push_back(entry);
+
+    size_t cut = chunk.size();
+    if (!eof) {
+      while (cut > 0 && chunk[cut-1] != '\n') cut--;
+      if (cut == 0) continue;
+    }
+    vector<char> rest;
+    rest.reserve(max(SAM_CHUNK_SIZE, chunk.size() - cut));
+    rest.assign(chunk.begin() + cut, chunk.end());
+    chunk.resize(cut);
+    sam_buffers.push_back(std::move(chunk));
+    vector<char> &buffer = sam_buffers.back();
+    MemoryTracker::global().add("sam buffers",
+                                MemoryTracker::vectorBytes(buffer));
+    Trace::Span span("parse sam chunk", "bytes", buffer.size());
+    SamEntry::parseBuffer(buffer.data(), buffer.data() + buffer.size(),
+                          keep, alignments, n_threads);
+    chunk = std::move(rest);
   }
 }
 
+bool GenomeMapper::passesFilter(sam_view const& rname, int mapq) {
+  if (mapq < MIN_MAPQ) {
+    return false;
+  }
+  if (CHROMOSOMES.empty()) {
+    return rname != "*";
+  }
+  for (string const& chr : CHROMOSOMES) {
+    if (rname == chr) return true;
+  }
+  return false;
+}
+
 void GenomeMapper::printAllAlignments(vector<SamEntry> &alignments){
   for(SamEntry &entry: alignments) {
-    cout << "FLAG  :" << entry.get<int>(SamEntry::FLAG) << endl;
-    cout << "CHR  :" << entry.get<string>(SamEntry::RNAME) << endl;
-    cout << "POS :" << entry.get<int>(SamEntry::POS) << endl;
-    cout << "HEALTHY: " << entry.get<string>(SamEntry::SEQ) << endl;
-    cout << "TUMOUR : " << entry.get<string>(SamEntry::HDR) << endl;
+    cout << "FLAG  :" << entry.flag << endl;
+    cout << "CHR  :" << entry.rname.str() << endl;
+    cout << "POS :" << entry.pos << endl;
+    cout << "HEALTHY: " << entry.seq.str() << endl;
+    if (findPair(entry) != nullptr) {
+      cout << "TUMOUR : " << findPair(entry)->mutated << endl;
+    }
     for(int i = 0; i < entry.snvLocSize(); i++) {
       cout << entry.snvLocation(i)  << ", ";
     }
@@ -425,11 +772,13 @@ void GenomeMapper::printAllAlignments(vector<SamEntry> &alignments){
 }
 
 void GenomeMapper::printSingleAlignment(SamEntry &entry) {
-  cout << "FLAG  :" << entry.get<int>(SamEntry::FLAG) << endl;
-  cout << "CHR  :" << entry.get<string>(SamEntry::RNAME) << endl;
-  cout << "POS :" << entry.get<int>(SamEntry::POS) << endl;
-  cout << "HELATHY :" << entry.get<string>(SamEntry::SEQ) << endl;
-  cout << "TUMOUR :" << entry.get<string>(SamEntry::HDR) << endl;
+  cout << "FLAG  :" << entry.flag << endl;
+  cout << "CHR  :" << entry.rname.str() << endl;
+  cout << "POS :" << entry.pos << endl;
+  cout << "HELATHY :" << entry.seq.str() << endl;
+  if (findPair(entry) != nullptr) {
+    cout << "TUMOUR :" << findPair(entry)->mutated << endl;
+  }
   for(int i = 0; i < entry.snvLocSize(); i++) {
     cout << entry.snvLocation(i)  << ", ";
   }
@@ -472,15 +821,14 @@ void GenomeMapper::correctReverseCompSNV(vector<SamEntry> &alignments) {
 
   for(SamEntry &entry : alignments) {
 
-    if(entry.get<int>(SamEntry::FLAG) == FORWARD_FLAG) {
+    if(entry.flag == FORWARD_FLAG) {
       for(int i = 0; i < entry.snvLocSize(); i++) {
         entry.setSNVLocation(i, entry.snvLocation(i) - 1);
       }
     }
-    else if(entry.get<int>(SamEntry::FLAG) == REVERSE_FLAG) { // convert indecies to rev comp and rev comp cns
-      entry.get<string>(SamEntry::HDR) = reverseComplementString(entry.get<string>(SamEntry::HDR));
+    else if(entry.flag == REVERSE_FLAG && findPair(entry) != nullptr) { // convert indecies to rev comp
       for(int i = 0; i < entry.snvLocSize(); i++) {
-        entry.setSNVLocation(i, entry.get<string>(SamEntry::HDR).size() - entry.snvLocation(i));
+        entry.setSNVLocation(i, findPair(entry)->mutated.size() - entry.snvLocation(i));
       }
     }
   }
@@ -488,18 +836,49 @@ void GenomeMapper::correctReverseCompSNV(vector<SamEntry> &alignments) {
 
 void GenomeMapper::identifySNVs(vector<SamEntry> &alignments) {
   for (SamEntry & entry : alignments) {
-      if(entry.get<int>(SamEntry::FLAG) == FORWARD_FLAG) {
-        countSNVs(entry, entry.get<int>(SamEntry::LEFT_OHANG));
+      consensus_pair const* pair = findPair(entry);
+      if (pair == nullptr) {
+        continue;
+      }
+      if(entry.flag == FORWARD_FLAG) {
+        countSNVs(entry, orientedMutated(entry, *pair), pair->left_ohang);
       }
-      else if (entry.get<int>(SamEntry::FLAG) == REVERSE_FLAG) {
-        entry.set(SamEntry::HDR, reverseComplementString(entry.get<string>(SamEntry::HDR))); 
-        countSNVs(entry, entry.get<int>(SamEntry::RIGHT_OHANG)); // invert overhangs due to rev comp
+      else if (entry.flag == REVERSE_FLAG) {
+        countSNVs(entry, orientedMutated(entry, *pair), pair->right_ohang); // invert overhangs due to rev comp
       }
   }
 }
-void GenomeMapper::countSNVs(SamEntry &alignment, int ohang) {
-  string mutated = alignment.get<string>(SamEntry::HDR);
-  string non_mutated = alignment.get<string>(SamEntry::SEQ);
+
+void GenomeMapper::indexConsensusPairs() {
+  pair_index.clear();
+  for (int i = 0; i < BPG->cnsPairSize(); i++) {
+    unsigned int id = BPG->getPair(i).pair_id;
+    if (id >= pair_index.size()) {
+      pair_index.resize(id + 1, -1);
+    }
+    pair_index[id] = i;
+  }
+}
+
+consensus_pair const* GenomeMapper::findPair(SamEntry const& entry) {
+  if (entry.pair_id < 0 || entry.pair_id >= (int) pair_index.size() ||
+      pair_index[entry.pair_id] < 0) {
+    return nullptr;
+  }
+  return &BPG->getPair(pair_index[entry.pair_id]);
+}
+
+string GenomeMapper::orientedMutated(SamEntry &entry,
+                                     consensus_pair const& pair) {
+  if (entry.flag == REVERSE_FLAG) {
+    return reverseComplementString(pair.mutated);
+  }
+  return pair.mutated;
+}
+
+void GenomeMapper::countSNVs(SamEntry &alignment, string const& mutated,
+                             int ohang) {
+  sam_view const& non_mutated = alignment.seq;
   // indel signature
   for(int i=0; i < mutated.size() - 1; i++) {
     if (mutated[i] != non_mutated[i + ohang] &&
@@ -539,39 +918,63 @@ void GenomeMapper::countSNVs(SamEntry &alignment, int ohang) {
 
 
 
+bool GenomeMapper::chromosomeLess(string const& a, string const& b) {
+  // compare past a common "chr" prefix, numbers as numbers, and
+  // numbered chromosomes before named ones (chrX, chrM)
+  size_t pa = a.compare(0, 3, "chr") == 0 ? 3 : 0;
+  size_t pb = b.compare(0, 3, "chr") == 0 ? 3 : 0;
+  bool na = pa < a.size() && isdigit(a[pa]);
+  bool nb = pb < b.size() && isdigit(b[pb]);
+  if (na && nb) {
+    long ia = atol(a.c_str() + pa), ib = atol(b.c_str() + pb);
+    if (ia != ib) return ia < ib;
+  }
+  else if (na != nb) {
+    return na;
+  }
+  return a < b;
+}
+
 bool GenomeMapper::compareSNVLocations(const single_snv &a, const single_snv &b) {
+  if (a.chr != b.chr) {
+    return chromosomeLess(a.chr, b.chr);
+  }
   return a.position < b.position;
 }
 
-
-void GenomeMapper::outputSNVToUser(vector<SamEntry> &alignments, string outName) {
-
-
+void GenomeMapper::collectSNVs(vector<SamEntry> &alignments,
+                               vector<single_snv> &separate_snvs) {
   // load each snv into a separate struct, so each can be easily sorted
-
-  vector<single_snv> separate_snvs;
   for(SamEntry & entry : alignments) {
+    if (entry.snvLocSize() == 0) {
+      continue;
+    }
+    consensus_pair const& pair = *findPair(entry);
+    string mutated = orientedMutated(entry, pair);
     for(int i=0; i < entry.snvLocSize(); i++) {
       int snv_index = entry.snvLocation(i);
       int overhang = 0;
-      if (entry.get<int>(SamEntry::FLAG) == FORWARD_FLAG) {
-        overhang = entry.get<int>(SamEntry::LEFT_OHANG);
+      if (entry.flag == FORWARD_FLAG) {
+        overhang = pair.left_ohang;
       }
-      else if (entry.get<int>(SamEntry::FLAG) == REVERSE_FLAG) {
-        overhang = entry.get<int>(SamEntry::RIGHT_OHANG);
+      else if (entry.flag == REVERSE_FLAG) {
+        overhang = pair.right_ohang;
       }
 
       single_snv snv;
-      snv.chr = entry.get<string>(SamEntry::RNAME);
-      snv.position = (entry.get<int>(SamEntry::POS) + snv_index + overhang); // location of snv
-      snv.healthy_base = entry.get<string>(SamEntry::SEQ)[snv_index + overhang];
-      snv.mutation_base = entry.get<string>(SamEntry::HDR)[snv_index];
-      snv.pair_id = entry.get<int>(SamEntry::BLOCK_ID);
+      snv.chr = entry.rname.str();
+      snv.position = (entry.pos + snv_index + overhang); // location of snv
+      snv.healthy_base = entry.seq.str()[snv_index + overhang];
+      snv.mutation_base = mutated[snv_index];
+      snv.pair_id = entry.pair_id;
 
       separate_snvs.push_back(snv);
     }
   }
+}
 
+void GenomeMapper::outputSNVToUser(vector<single_snv> &separate_snvs, 
+                                   string outName) {
   // sort the snvs 
   std::sort(separate_snvs.begin(), separate_snvs.end(), compareSNVLocations);
   
@@ -8,6 +8,8 @@
 #include "BranchPointGroups.h"
 #include "Reads.h"
 #include "SamEntry.h"
+#include "BlockingQueue.h"
+#include "BwaAligner.h"
 
 struct snv_aln_info {
  std::vector<int> SNV_pos;
@@ -31,15 +33,37 @@ struct single_snv {
 };
 
 class GenomeMapper {
+  friend class KernelBenchmarks;
 
 private:
 
   const int MIN_MAPQ;
-  const std::string CHR;
+  const std::vector<std::string> CHROMOSOMES; // empty for all
+  const bool SPLIT_OUTPUT;
+  const std::string BWT_IDX;
+  std::string fastqName, samName, outName, outPrefix;
 
   BranchPointGroups *BPG; // access to breakpoint groups
   ReadsManipulator *reads;
 
+  std::vector<SamEntry> alignments;
+  std::vector< std::vector<char> > sam_buffers; // sam text alignments
+                                               // point into
+  std::vector<bwa_record> bwa_records;         // in process alignments
+                                               // point into
+  std::vector<int> pair_index;
+  // pair_id -> index of the pair in BPG's consensus pairs, -1 if the
+  // block gave no pair. Only the pair_id is sent through the aligner,
+  // so alignments are joined back to their pairs through this table
+
+  void indexConsensusPairs();
+  // builds pair_index, once all consensus pairs are built
+  consensus_pair const* findPair(SamEntry const& entry);
+  // the consensus pair aligned in entry, nullptr if there is none
+  bool aligned_in_memory; // alignments already made, without a sam file
+  unsigned int n_aligned; // consensus pairs sent to the aligner
+  unsigned int n_called;  // alignments passing the filter
+
 
   void buildConsensusPairs();
   // Function fills the consensus_pairs vector with 
@@ -49,11 +73,14 @@ private:
   void identifySNVs(std::vector<SamEntry> &alignments);
   // iterates through alignments and calls countSNVs() to identify mutations
   // handles reverse complement aligment of the healthy cns
-  void countSNVs(SamEntry &alignment, int left);
+  void countSNVs(SamEntry &alignment, std::string const& mutated, int left);
   // use of the overhand allows the healthy and cancer consensus sequences
   // to be correctly lined up for mutation identification, whilst at
   // the same time, allows the entire healthy sequence to be aligned
   // to the genome
+  std::string orientedMutated(SamEntry &entry, consensus_pair const& pair);
+  // the mutated cns of entry, reverse complemented if the alignment
+  // is on the reverse strand, so it lines up with SEQ
 
 
 
@@ -65,11 +92,21 @@ private:
   // aligned healthy read. This allows identification
   // of the mutation indexes directly from the SAM file
 
-  void constructSNVFastqData(std::string const& samName);
+  void constructSNVFastqData(BlockingQueue<consensus_pair> &pairs,
+                             std::string const& fastqName);
   // generates the fastq file of non_mutated reads to align
-  // to the refrence genome. 
+  // to the refrence genome, from the pairs popped from pairs until
+  // it is closed.
   // a fastq element has format 
 
+  std::string fastqRecord(consensus_pair const& cns_pair);
+  // formats cns_pair as a four line fastq record, as written by
+  // constructSNVFastqData()
+
+  void feedAligner(BlockingQueue<consensus_pair> &pairs, int fd);
+  // writes the fastq records of the pairs popped from pairs to fd
+  // until pairs is closed, then closes fd
+
   void callBWA();
   // Function first calls bwa aln:
   // cmd ./bwa/bwa aln -t 16 hg19.fa cns_pairs.fastq > cns_pairs.sai
@@ -97,22 +134,82 @@ private:
   void maskLowQualityPositions(consensus_pair & pair, bool &low_quality);
 
 
-  void parseSamFile(std::vector<SamEntry> &alignments, std::string filename);
+  void parseSamFile(std::string filename, int n_threads);
+  void readSam(int fd, int n_threads);
+  // parses the sam read from fd into alignments, in chunks parsed by
+  // n_threads threads, keeping the alignments that pass the filter
+  bool passesFilter(sam_view const& rname, int mapq);
+  // True if the alignment is to one of CHROMOSOMES (any, if empty)
+  // with mapq at least MIN_MAPQ
+  SamEntry samEntryFromRecord(bwa_record const& r, unsigned int pair_id);
   void printAllAlignments(std::vector<SamEntry> &alignments);
 
   void printSingleAlignment(SamEntry &snv);
   std::string reverseComplementString(std::string s);
   void correctReverseCompSNV(std::vector<SamEntry> &alignments);
+  void partitionByChromosome(std::vector<std::string> &chr_names,
+      std::vector< std::vector<SamEntry> > &chr_alignments);
+  // Moves alignments into one vector per chromosome, in one pass.
+  // chr_names[c] is the chromosome of chr_alignments[c]. Every chromosome
+  // of CHROMOSOMES gets a vector, even if empty.
+  static bool chromosomeLess(std::string const& a, std::string const& b);
+  // orders chromosome names naturally: chr2 before chr10
   static bool compareSNVLocations(const single_snv &a, const single_snv &b);
-  void outputSNVToUser(std::vector<SamEntry> &alignments, std::string report_filename);
+  // orders by chromosome, then position
+  void collectSNVs(std::vector<SamEntry> &alignments,
+                   std::vector<single_snv> &snvs);
+  // appends the snvs found in alignments by identifySNVs() to snvs
+  void outputSNVToUser(std::vector<single_snv> &snvs, std::string report_filename);
+  // sorts snvs by position and writes them to report_filename
 
   void printGaps(int gaps);
 
 public:
     GenomeMapper(BranchPointGroups &bpgroups, ReadsManipulator &reads,
                  std::string outpath, std::string const& basename,
-                 std::string const& chr, std::string const& bwt_idx,
+                 std::vector<std::string> const& chromosomes,
+                 bool split_output, std::string const& bwt_idx,
                  int min_mapq);
+    // Constructor only sets up output filenames. SNVs are called on the
+    // alignments to chromosomes, or to any chromosome if chromosomes is
+    // empty. With split_output, the SNVs of each chromosome are written
+    // to their own <basename>.<chromosome>.SNV_results file, otherwise
+    // all are written, sorted by chromosome and position, to
+    // <basename>.SNV_results. The pipeline stages are run by
+    // writeFastq(), alignFastq() then callSNVs()
+
+    void writeFastq(BlockingQueue<consensus_pair> &pairs);
+    // Writes the consensus pairs streamed through pairs to the fastq 
+    // file, returning once pairs is closed
+
+    void alignFastq(int n_threads);
+    // Aligns the fastq file to the reference with Bowtie2, running
+    // n_threads alignment threads
+
+    void alignStreaming(BlockingQueue<consensus_pair> &pairs, int n_threads);
+    // Alternative to writeFastq() and alignFastq(). Runs Bowtie2 with
+    // n_threads threads reading fastq records from a pipe and writing sam
+    // to a pipe. The pairs streamed through pairs are fed to Bowtie2 by
+    // a writer thread while the sam is parsed, so no fastq or sam file
+    // is written. Throws runtime_error if Bowtie2 fails.
+
+    void alignInMemory(BlockingQueue<consensus_pair> &pairs,
+                       BwaAligner &aligner, int n_threads);
+    // Alternative to writeFastq() and alignFastq(). Collects the
+    // non_mutated sequence and pair_id of the pairs streamed through
+    // pairs, and aligns them in process with aligner, n_threads at once.
+    // No fastq or sam file is written, and no copy of the pairs is kept.
+
+    void callSNVs(int n_threads);
+    // Parses the alignments with n_threads threads, unless made by
+    // alignStreaming() or alignInMemory(), partitions them by
+    // chromosome, calls the chromosomes in parallel and writes
+    // the SNVs found to the results file
+
+    unsigned int pairsAligned() { return n_aligned; }
+    // number of consensus pairs sent to the aligner
+    unsigned int alignmentsCalled() { return n_called; }
+    // number of alignments SNVs were called on
 
     std::vector<consensus_pair> consensus_pairs;
     void printConsensusPairs();
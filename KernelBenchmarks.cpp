@@ -0,0 +1,275 @@
+// KernelBenchmarks.cpp
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "KernelBenchmarks.h"
+#include "SyntheticReads.h"
+#include "BenchSupport.h"
+#include "util_funcs.h"
+#include "string.h"
+#include "SamEntry.h"
+
+using namespace std;
+
+// Data set. Reads are 100bp at 20x over a 100kb genome, per tissue, with
+// a tumour SNV every 1000bp and Illumina like error and quality profiles
+static const unsigned long GENOME_SEED = 20160601;
+static const unsigned long INPUT_SEED = 3;
+static const unsigned int GENOME_LENGTH = 100000;
+static const unsigned int READ_LENGTH = 100;
+static const unsigned int SNV_SPACING = 1000;
+static const double ERROR_RATE = 0.002;
+static const double N_RATE = 0.0005;
+
+// Kernel inputs
+static const unsigned int N_LCP = 200000;
+static const unsigned int N_QUERIES = 20000;
+static const unsigned int QUERY_LENGTH = 30;
+static const unsigned int N_SEQUENCES = 20000;
+static const unsigned int N_CONSENSUS_BLOCKS = 5000;
+static const unsigned int N_SAM_LINES = 50000;
+static const unsigned int N_BSA_SEARCHES = 200000;
+
+KernelBenchmarks::KernelBenchmarks(int repetitions):
+REPETITIONS(repetitions) {
+  cout << "Generating " << SYNTHETIC_COVERAGE << "x of " << READ_LENGTH
+       << "bp reads over a " << GENOME_LENGTH << "bp genome..." << endl;
+  synthetic_options options;
+  options.genome_length = GENOME_LENGTH;
+  options.read_length = READ_LENGTH;
+  options.coverage = SYNTHETIC_COVERAGE;
+  options.snv_spacing = SNV_SPACING;
+  options.seed = GENOME_SEED;
+  options.error_rate = ERROR_RATE;
+  options.n_rate = N_RATE;
+  SyntheticReads read_set(options, "gedi_bench", &raw_reads);
+
+  cout << "Building suffix array and seed blocks..." << endl;
+  {
+    CoutSilencer silence;
+    reads.reset(new ReadsManipulator(1, read_set.inputFile()));
+    SA.reset(new SuffixArray(*reads, reads->getMinSuffixSize(), 1));
+    BPG.reset(new BranchPointGroups(*SA, *reads, MIN_PHRED, GSA1_MCT,
+        GSA2_MCT, COVERAGE_UPPER_THRESHOLD, 1, MAX_LOW_CONFIDENCE_POS,
+        ECONT, ALLELE_FREQ_OF_ERR));
+    mapper.reset(new GenomeMapper(*BPG, *reads, "./", "bench",
+        vector<string>(), false, "", MIN_MAPQ));
+  }
+  generateInputs();
+  generateSam();
+  cout << reads->getSize(HEALTHY) << " healthy and "
+       << reads->getSize(TUMOUR) << " tumour reads, " << SA->getSize()
+       << " suffixes, " << BPG->nSeedBlocks() << " seed blocks" << endl;
+}
+
+void KernelBenchmarks::generateInputs() {
+  mt19937_64 rng(INPUT_SEED);
+  uniform_int_distribution<unsigned int> sa_index(0, SA->getSize() - 2);
+  for (unsigned int i = 0; i < N_LCP; i++) {
+    lcp_indices.push_back(sa_index(rng));
+  }
+
+  uniform_int_distribution<unsigned int> tumour_read(
+      0, reads->getSize(TUMOUR) - 1);
+  while (queries.size() < N_QUERIES) {
+    string const& read = reads->getReadByIndex(tumour_read(rng), TUMOUR);
+    if (read.size() < QUERY_LENGTH + 1) continue;      // + '$'
+    uniform_int_distribution<unsigned int> offset(
+        0, read.size() - 1 - QUERY_LENGTH);
+    queries.push_back(read.substr(offset(rng), QUERY_LENGTH));
+  }
+
+  for (unsigned int i = 0; i < N_SEQUENCES && i < reads->getSize(TUMOUR);
+       i++) {
+    string const& read = reads->getReadByIndex(i, TUMOUR);
+    sequences.push_back(read.substr(0, read.size() - 1));
+  }
+
+  SA->generateBSA(bsa, TUMOUR);
+  unsigned int last = reads->getSize(TUMOUR) - 1;
+  unsigned int concat_size = bsa.back().second +
+                             reads->getReadByIndex(last, TUMOUR).size();
+  uniform_int_distribution<unsigned int> position(0, concat_size - 1);
+  for (unsigned int i = 0; i < N_BSA_SEARCHES; i++) {
+    concat_positions.push_back(position(rng));
+  }
+}
+
+void KernelBenchmarks::generateSam() {
+  // unpaired Bowtie2 output: mostly unique full length matches, some
+  // with indels, some ambiguous (MAPQ 0) or unaligned
+  sam_text = "@HD\tVN:1.0\tSO:unsorted\n@SQ\tSN:chr1\tLN:100000\n"
+             "@PG\tID:bowtie2\tPN:bowtie2\tVN:2.2.6\n";
+  for (unsigned int i = 0; i < N_SAM_LINES; i++) {
+    fastq_t const& read = raw_reads[i % raw_reads.size()];
+    bool unaligned = (i % 50 == 0);
+    string cigar = (i % 7 == 0) ? "40M2I58M" :
+                   (i % 11 == 0) ? "30M1D70M" : "100M";
+    sam_text += to_string(i) + "\t" +
+                (unaligned ? "4\t*\t0\t0\t*" :
+                 string(i % 2 ? "16" : "0") + "\tchr1\t" +
+                 to_string(1 + i * 7 % (GENOME_LENGTH - READ_LENGTH)) +
+                 "\t" + (i % 10 == 0 ? "1" : "42") + "\t" + cigar) +
+                "\t*\t0\t0\t" + read.seq + "\t" + read.qual +
+                "\tAS:i:-5\tXN:i:0\tXM:i:1\tXO:i:0\tXG:i:0\tNM:i:1"
+                "\tMD:Z:50A49\tYT:Z:UU\n";
+  }
+}
+
+void KernelBenchmarks::time(string const& name, unsigned long ops,
+    function<unsigned long long()> const& body) {
+  unsigned long long check = body();       // warm up
+  vector<double> ns_per_op;
+  bool stable = true;
+  for (int r = 0; r < REPETITIONS; r++) {
+    auto start = chrono::steady_clock::now();
+    unsigned long long run_check = body();
+    auto end = chrono::steady_clock::now();
+    ns_per_op.push_back(
+        chrono::duration<double, nano>(end - start).count() / ops);
+    stable = stable && (run_check == check);
+  }
+  sort(ns_per_op.begin(), ns_per_op.end());
+  cout << left << setw(44) << name << right
+       << setw(10) << ops
+       << fixed << setprecision(1)
+       << setw(14) << ns_per_op.front()
+       << setw(14) << ns_per_op[ns_per_op.size() / 2]
+       << "  " << check << (stable ? "" : " (differs between runs)")
+       << endl;
+  cout.unsetf(ios::floatfield);
+  cout << setprecision(6);
+}
+
+void KernelBenchmarks::run(string const& filter) {
+  struct benchmark {
+    string name;
+    unsigned long ops;
+    unsigned long long (KernelBenchmarks::*body)();
+  };
+  vector<benchmark> benchmarks = {
+    {"computeLCP", N_LCP, &KernelBenchmarks::benchComputeLCP},
+    {"BranchPointGroups::binarySearch", N_QUERIES,
+     &KernelBenchmarks::benchSearch},
+    {"reverseComplementString", sequences.size(),
+     &KernelBenchmarks::benchReverseComplement},
+    {"BranchPointGroups::reverseComplementString", sequences.size(),
+     &KernelBenchmarks::benchBPGReverseComplement},
+    {"GenomeMapper::reverseComplementString", sequences.size(),
+     &KernelBenchmarks::benchMapperReverseComplement},
+    {"qualityProcessRawData", raw_reads.size(),
+     &KernelBenchmarks::benchQualityProcess},
+    {"generateConsensusSequence",
+     min<unsigned long>(N_CONSENSUS_BLOCKS, BPG->nSeedBlocks()),
+     &KernelBenchmarks::benchConsensus},
+    {"SamEntry::parseBuffer", N_SAM_LINES, &KernelBenchmarks::benchSamParse},
+    {"SuffixArray::binarySearch", N_BSA_SEARCHES,
+     &KernelBenchmarks::benchBSASearch},
+  };
+
+  cout << left << setw(44) << "benchmark" << right << setw(10) << "ops"
+       << setw(14) << "best ns/op" << setw(14) << "median ns/op"
+       << "  check" << endl;
+  for (benchmark const& b : benchmarks) {
+    if (b.name.find(filter) == string::npos || b.ops == 0) continue;
+    time(b.name, b.ops, bind(b.body, this));
+  }
+}
+
+unsigned long long KernelBenchmarks::benchComputeLCP() {
+  unsigned long long check = 0;
+  for (unsigned int i : lcp_indices) {
+    check += computeLCP(SA->getElem(i), SA->getElem(i + 1), *reads);
+  }
+  return check;
+}
+
+unsigned long long KernelBenchmarks::benchSearch() {
+  unsigned long long check = 0;
+  for (string const& query : queries) {
+    check += BPG->binarySearch(query) + 1;     // -1 if not found
+  }
+  return check;
+}
+
+unsigned long long KernelBenchmarks::benchReverseComplement() {
+  unsigned long long check = 0;
+  for (string const& s : sequences) {
+    string rc = reverseComplementString(s);
+    check += rc.size() + rc[0];
+  }
+  return check;
+}
+
+unsigned long long KernelBenchmarks::benchBPGReverseComplement() {
+  unsigned long long check = 0;
+  for (string const& s : sequences) {
+    string rc = BPG->reverseComplementString(s);
+    check += rc.size() + rc[0];
+  }
+  return check;
+}
+
+unsigned long long KernelBenchmarks::benchMapperReverseComplement() {
+  unsigned long long check = 0;
+  for (string const& s : sequences) {
+    string rc = mapper->reverseComplementString(s);
+    check += rc.size() + rc[0];
+  }
+  return check;
+}
+
+unsigned long long KernelBenchmarks::benchQualityProcess() {
+  vector<string> processed_reads, processed_phreds;
+  CoutSilencer silence;         // it reports the section it processes
+  reads->qualityProcessRawData(&raw_reads, &processed_reads,
+                               &processed_phreds, 0, raw_reads.size(), 0);
+  unsigned long long check = 0;
+  for (string const& read : processed_reads) {
+    check += read.size();
+  }
+  return check;
+}
+
+unsigned long long KernelBenchmarks::benchConsensus() {
+  consensus_scratch scratch;
+  unsigned long long check = 0;
+  unsigned int n = min<unsigned int>(N_CONSENSUS_BLOCKS, BPG->nSeedBlocks());
+  for (unsigned int b = 0; b < n; b++) {
+    int offset;
+    unsigned int pair_id;
+    string cns, qual;
+    BPG->generateConsensusSequence(TUMOUR, BPG->SeedBlocks[b], offset,
+                                   pair_id, cns, qual, scratch);
+    check += cns.size() + offset;
+  }
+  return check;
+}
+
+unsigned long long KernelBenchmarks::benchSamParse() {
+  vector<SamEntry> entries;
+  SamEntry::parseBuffer(sam_text.data(), sam_text.data() + sam_text.size(),
+      [](sam_view const& rname, int mapq) {
+        return mapq >= MIN_MAPQ && rname != "*";
+      }, entries, 1);
+  unsigned long long check = 0;
+  for (SamEntry const& entry : entries) {
+    check += entry.pos;
+  }
+  return check;
+}
+
+unsigned long long KernelBenchmarks::benchBSASearch() {
+  unsigned long long check = 0;
+  for (unsigned int position : concat_positions) {
+    check += SA->binarySearch(bsa, position).first;
+  }
+  return check;
+}
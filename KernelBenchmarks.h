@@ -0,0 +1,72 @@
+// KernelBenchmarks.h
+#ifndef KERNELBENCHMARKS_H
+#define KERNELBENCHMARKS_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <utility>
+
+#include "Reads.h"
+#include "SuffixArray.h"
+#include "BranchPointGroups.h"
+#include "GenomeMapper.h"
+
+class KernelBenchmarks {
+  // Microbenchmarks of GeDi's core kernels, run by `make bench`.
+  // The genome, reads, qualities, queries and sam lines are synthetic and
+  // drawn from fixed seeds, so every run on the same build and machine
+  // sees the same inputs and results are comparable over time. The
+  // kernels run on real GeDi objects, built by running the pipeline up to
+  // the seed blocks on the synthetic reads. Kernels private to their
+  // classes are reached as a friend.
+
+public:
+  KernelBenchmarks(int repetitions);
+  // Generates the data set and builds the objects the kernels need.
+  // Each benchmark is timed repetitions times, after one warm up run
+
+  void run(std::string const& filter);
+  // Runs the benchmarks whose names contain filter, printing one line
+  // each: the operations per run, the best and median time per
+  // operation, and a check value computed from the kernel's results,
+  // which only changes if the kernel's output does
+
+private:
+  const int REPETITIONS;
+  std::unique_ptr<ReadsManipulator> reads;
+  std::unique_ptr<SuffixArray> SA;
+  std::unique_ptr<BranchPointGroups> BPG;
+  std::unique_ptr<GenomeMapper> mapper;
+
+  std::vector<fastq_t> raw_reads;          // tumour reads before filtering
+  std::vector<unsigned int> lcp_indices;   // GSA1 index pairs (i, i+1)
+  std::vector<std::string> queries;        // 30bp tumour read substrings
+  std::vector<std::string> sequences;      // reads without the '$'
+  std::string sam_text;
+  std::vector<std::pair<unsigned int, unsigned int> > bsa;
+  std::vector<unsigned int> concat_positions;   // into the tumour concat
+
+  void generateInputs();
+  // draws the kernel inputs from the built objects
+  void generateSam();
+  // sam_text: Bowtie2 like alignments of the synthetic reads
+
+  void time(std::string const& name, unsigned long ops,
+            std::function<unsigned long long()> const& body);
+  // Times body, which performs ops operations and returns its check
+  // value, and prints the result line
+
+  unsigned long long benchComputeLCP();
+  unsigned long long benchSearch();
+  unsigned long long benchReverseComplement();
+  unsigned long long benchBPGReverseComplement();
+  unsigned long long benchMapperReverseComplement();
+  unsigned long long benchQualityProcess();
+  unsigned long long benchConsensus();
+  unsigned long long benchSamParse();
+  unsigned long long benchBSASearch();
+};
+
+#endif
@@ -0,0 +1,142 @@
+// MemoryTracker.cpp
+#include <string>
+#include <vector>
+#include <mutex>
+#include <iostream>
+#include <iomanip>
+
+#include "MemoryTracker.h"
+#include "Metrics.h"
+
+using namespace std;
+
+static double toMB(size_t bytes) {
+  return bytes / (1024.0 * 1024.0);
+}
+
+MemoryTracker::MemoryTracker(): live(0), peak(0), peak_stage(-1) {}
+
+MemoryTracker & MemoryTracker::global() {
+  static MemoryTracker tracker;
+  return tracker;
+}
+
+structure_memory & MemoryTracker::record(string const& structure) {
+  for (structure_memory &r : records) {
+    if (r.name == structure) return r;
+  }
+  structure_memory r;
+  r.name = structure;
+  r.live_bytes = r.peak_bytes = 0;
+  records.push_back(r);
+  return records.back();
+}
+
+void MemoryTracker::update(structure_memory &r, size_t bytes) {
+  live = live - r.live_bytes + bytes;
+  r.live_bytes = bytes;
+  if (bytes > r.peak_bytes) {
+    r.peak_bytes = bytes;
+  }
+  if (live > peak) {
+    peak = live;
+    peak_stage = Metrics::currentStage();
+    peak_breakdown.resize(records.size());
+    for (unsigned int i = 0; i < records.size(); i++) {
+      peak_breakdown[i] = records[i].live_bytes;
+    }
+  }
+}
+
+void MemoryTracker::set(string const& structure, size_t bytes) {
+  std::lock_guard<std::mutex> guard(lock);
+  update(record(structure), bytes);
+}
+
+void MemoryTracker::add(string const& structure, long long delta) {
+  std::lock_guard<std::mutex> guard(lock);
+  structure_memory &r = record(structure);
+  long long bytes = (long long) r.live_bytes + delta;
+  update(r, bytes > 0 ? bytes : 0);
+}
+
+void MemoryTracker::release(string const& structure) {
+  set(structure, 0);
+}
+
+size_t MemoryTracker::liveBytes() {
+  std::lock_guard<std::mutex> guard(lock);
+  return live;
+}
+
+size_t MemoryTracker::peakBytes() {
+  std::lock_guard<std::mutex> guard(lock);
+  return peak;
+}
+
+vector<structure_memory> MemoryTracker::structures() {
+  std::lock_guard<std::mutex> guard(lock);
+  return records;
+}
+
+void MemoryTracker::printStage(string const& stage) {
+  std::lock_guard<std::mutex> guard(lock);
+  cout << fixed << setprecision(1);
+  cout << "Memory after " << stage << ": " << toMB(live) << "MB live (";
+  bool first = true;
+  for (structure_memory const& r : records) {
+    if (r.live_bytes == 0) continue;
+    cout << (first ? "" : ", ") << r.name << " " << toMB(r.live_bytes)
+         << "MB";
+    first = false;
+  }
+  cout << "), " << toMB(peak) << "MB peak" << endl;
+  cout.unsetf(ios::floatfield);
+  cout << setprecision(6);
+}
+
+void MemoryTracker::printPeak() {
+  string stage;
+  int stage_id;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stage_id = peak_stage;
+  }
+  // Metrics is not called with lock held: it calls back into the tracker
+  if (stage_id >= 0) {
+    stage = Metrics::global().stageName(stage_id);
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+  cout << fixed << setprecision(1);
+  cout << "Peak tracked memory: " << toMB(peak) << "MB";
+  if (!stage.empty()) {
+    cout << ", reached during " << stage;
+  }
+  cout << endl;
+  for (unsigned int i = 0; i < peak_breakdown.size(); i++) {
+    if (peak_breakdown[i] == 0) continue;
+    cout << "  " << records[i].name << ": " << toMB(peak_breakdown[i])
+         << "MB (" << setprecision(0) << 100.0 * peak_breakdown[i] / peak
+         << "%)" << setprecision(1) << endl;
+  }
+  cout.unsetf(ios::floatfield);
+  cout << setprecision(6);
+}
+
+size_t MemoryTracker::stringBytes(string const& s) {
+  // small strings live inside the string object
+  const char *object = (const char*) &s;
+  if (s.data() >= object && s.data() < object + sizeof(string)) {
+    return 0;
+  }
+  return s.capacity() + 1;
+}
+
+size_t MemoryTracker::stringsBytes(vector<string> const& v) {
+  size_t bytes = vectorBytes(v);
+  for (string const& s : v) {
+    bytes += stringBytes(s);
+  }
+  return bytes;
+}
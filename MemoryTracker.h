@@ -0,0 +1,79 @@
+// MemoryTracker.h
+#ifndef MEMORYTRACKER_H
+#define MEMORYTRACKER_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstddef>
+
+struct structure_memory {
+  std::string name;
+  size_t live_bytes;         // bytes held now
+  size_t peak_bytes;         // most bytes ever held at once
+};
+
+class MemoryTracker {
+  // Process wide account of the bytes held by GeDi's large data
+  // structures: the read store, the suffix array and its temporaries,
+  // the extraction bitmap, the seed blocks and the consensus pairs.
+  // Structures are registered explicitly by their owners, which set
+  // their size after building or freeing them, so the account costs
+  // nothing inside the hot loops. Sizes count allocated capacity, not
+  // used size.
+  // The total of all live structures is tracked, and a copy of the
+  // breakdown is kept whenever the total reaches a new peak, so the
+  // structures responsible for the peak can be reported afterwards.
+
+public:
+  static MemoryTracker & global();
+
+  void set(std::string const& structure, size_t bytes);
+  // structure holds bytes from now on. Setting 0 releases it
+  void add(std::string const& structure, long long delta);
+  // structure grows by delta bytes, or shrinks if delta is negative
+  void release(std::string const& structure);
+  // same as set(structure, 0)
+
+  size_t liveBytes();
+  // bytes held by all structures now
+  size_t peakBytes();
+  // most bytes held by all structures at once
+
+  std::vector<structure_memory> structures();
+  // every structure ever registered, in order of registration
+
+  void printStage(std::string const& stage);
+  // prints the live total and the live structures to cout, at the end
+  // of stage
+  void printPeak();
+  // prints the peak total, the stage that reached it and the bytes each
+  // structure held at that moment
+
+  template <class T>
+  static size_t vectorBytes(std::vector<T> const& v) {
+    return v.capacity() * sizeof(T);
+  }
+  // bytes allocated by v, not counting what its elements allocate
+
+  static size_t stringBytes(std::string const& s);
+  // bytes allocated by s, 0 if s fits in the string object itself
+  static size_t stringsBytes(std::vector<std::string> const& v);
+  // bytes allocated by v and all its strings
+
+private:
+  std::mutex lock;
+  std::vector<structure_memory> records;
+  size_t live;
+  size_t peak;
+  std::vector<size_t> peak_breakdown;  // live bytes of records at peak
+  int peak_stage;                      // Metrics stage that reached peak
+
+  MemoryTracker();
+  structure_memory & record(std::string const& structure);
+  // the record of structure, added if it is new. lock must be held
+  void update(structure_memory &r, size_t bytes);
+  // sets r to bytes and tracks the peak. lock must be held
+};
+
+#endif
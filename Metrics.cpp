@@ -0,0 +1,372 @@
+// Metrics.cpp
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <stdexcept>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "Metrics.h"
+#include "MemoryTracker.h"
+
+using namespace std;
+
+// The stage this thread works for, and its cpu time when last charged
+static thread_local int current_stage = -1;
+static thread_local long long charged_ns = 0;
+static thread_local long long charged_perf[N_PERF_COUNTERS] = {-1, -1, -1,
+                                                               -1, -1};
+
+static long long threadCpuNs() {
+  struct timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static bool perfCounted(int counter) {
+  return PerfCounters::enabled() && PerfCounters::available(counter);
+}
+
+static double toMs(struct timeval const& t) {
+  return t.tv_sec * 1000.0 + t.tv_usec / 1000.0;
+}
+
+static double childCpuMs() {
+  struct rusage usage;
+  getrusage(RUSAGE_CHILDREN, &usage);
+  return toMs(usage.ru_utime) + toMs(usage.ru_stime);
+}
+
+static long peakRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+static long rssKb() {
+  long pages = 0, resident = 0;
+  ifstream statm("/proc/self/statm");
+  if (!(statm >> pages >> resident)) {
+    return 0;
+  }
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+Metrics::Metrics(): process_start(chrono::steady_clock::now()) {
+  for (int s = 0; s < MAX_STAGES; s++) {
+    cpu_ns[s] = 0;
+    for (int c = 0; c < N_PERF_COUNTERS; c++) {
+      perf_counts[s][c] = 0;
+    }
+    for (int c = 0; c < N_OP_COUNTERS; c++) {
+      op_counts[s][c] = 0;
+    }
+  }
+}
+
+Metrics & Metrics::global() {
+  static Metrics metrics;
+  return metrics;
+}
+
+void Metrics::chargeThread() {
+  long long now = threadCpuNs();
+  if (current_stage >= 0) {
+    global().cpu_ns[current_stage] += now - charged_ns;
+  }
+  charged_ns = now;
+
+  unsigned long long ops[N_OP_COUNTERS];
+  OpCounters::take(ops);
+  if (current_stage >= 0) {
+    mergeOps(current_stage, ops);
+  }
+
+  if (!PerfCounters::enabled()) return;
+  long long counts[N_PERF_COUNTERS];
+  PerfCounters::read(counts);
+  for (int c = 0; c < N_PERF_COUNTERS; c++) {
+    // scaled counts of multiplexed counters can step back slightly
+    if (current_stage >= 0 && charged_perf[c] >= 0 &&
+        counts[c] > charged_perf[c]) {
+      global().perf_counts[current_stage][c] += counts[c] - charged_perf[c];
+    }
+    charged_perf[c] = counts[c];
+  }
+}
+
+void Metrics::mergeOps(int stage, unsigned long long ops[N_OP_COUNTERS]) {
+  for (int c = 0; c < N_OP_COUNTERS; c++) {
+    if (ops[c] == 0) continue;
+    std::atomic<unsigned long long> &count = global().op_counts[stage][c];
+    if (!OpCounters::isMax(c)) {
+      count += ops[c];
+      continue;
+    }
+    unsigned long long seen = count.load();
+    while (ops[c] > seen && !count.compare_exchange_weak(seen, ops[c])) {}
+  }
+}
+
+int Metrics::currentStage() {
+  return current_stage;
+}
+
+int Metrics::enterStage(int stage) {
+  chargeThread();
+  int previous = current_stage;
+  current_stage = stage;
+  return previous;
+}
+
+void Metrics::leaveStage(int previous) {
+  chargeThread();
+  current_stage = previous;
+}
+
+int Metrics::beginStage(string const& name) {
+  std::lock_guard<std::mutex> guard(lock);
+  if (records.size() == MAX_STAGES) {
+    throw std::logic_error("Metrics: more than 64 stages");
+  }
+  stage_record r;
+  r.m.name = name;
+  r.m.wall_ms = r.m.cpu_ms = r.m.child_cpu_ms = 0;
+  r.m.peak_rss_kb = r.m.rss_kb = 0;
+  r.m.tracked_kb = r.m.tracked_peak_kb = 0;
+  for (int c = 0; c < N_PERF_COUNTERS; c++) {
+    r.m.perf[c] = -1;
+  }
+  for (int c = 0; c < N_OP_COUNTERS; c++) {
+    r.m.ops[c] = 0;
+  }
+  r.m.items = 0;
+  r.start = chrono::steady_clock::now();
+  r.child_cpu_start = childCpuMs();
+  r.done = false;
+  records.push_back(r);
+  return records.size() - 1;
+}
+
+void Metrics::endStage(int stage) {
+  long tracked_kb = MemoryTracker::global().liveBytes() / 1024;
+  long tracked_peak_kb = MemoryTracker::global().peakBytes() / 1024;
+  std::lock_guard<std::mutex> guard(lock);
+  stage_record &r = records[stage];
+  r.m.wall_ms = chrono::duration<double, milli>(
+      chrono::steady_clock::now() - r.start).count();
+  r.m.child_cpu_ms = childCpuMs() - r.child_cpu_start;
+  r.m.peak_rss_kb = peakRssKb();
+  r.m.rss_kb = rssKb();
+  r.m.tracked_kb = tracked_kb;
+  r.m.tracked_peak_kb = tracked_peak_kb;
+  r.done = true;
+}
+
+void Metrics::setItems(string const& stage, unsigned long items,
+                       string const& unit) {
+  std::lock_guard<std::mutex> guard(lock);
+  for (stage_record &r : records) {
+    if (r.m.name == stage) {
+      r.m.items = items;
+      r.m.item_unit = unit;
+    }
+  }
+}
+
+string Metrics::stageName(int stage) {
+  std::lock_guard<std::mutex> guard(lock);
+  return records[stage].m.name;
+}
+
+vector<stage_metrics> Metrics::stages() {
+  chargeThread();
+  long tracked_kb = MemoryTracker::global().liveBytes() / 1024;
+  long tracked_peak_kb = MemoryTracker::global().peakBytes() / 1024;
+  std::lock_guard<std::mutex> guard(lock);
+  vector<stage_metrics> result;
+  for (unsigned int s = 0; s < records.size(); s++) {
+    if (!records[s].done) continue;
+    result.push_back(records[s].m);
+    result.back().cpu_ms = cpu_ns[s] / 1e6;
+    for (int c = 0; c < N_PERF_COUNTERS; c++) {
+      result.back().perf[c] = perfCounted(c) ? perf_counts[s][c].load() : -1;
+    }
+    for (int c = 0; c < N_OP_COUNTERS; c++) {
+      result.back().ops[c] = op_counts[s][c];
+    }
+  }
+
+  struct rusage self;
+  getrusage(RUSAGE_SELF, &self);
+  stage_metrics total;
+  total.name = "total";
+  total.wall_ms = chrono::duration<double, milli>(
+      chrono::steady_clock::now() - process_start).count();
+  total.cpu_ms = toMs(self.ru_utime) + toMs(self.ru_stime);
+  total.child_cpu_ms = childCpuMs();
+  total.peak_rss_kb = self.ru_maxrss;
+  total.rss_kb = rssKb();
+  total.tracked_kb = tracked_kb;
+  total.tracked_peak_kb = tracked_peak_kb;
+  total.items = 0;
+  for (int c = 0; c < N_PERF_COUNTERS; c++) {
+    total.perf[c] = -1;
+    if (!perfCounted(c)) continue;
+    total.perf[c] = 0;        // threads only count while working for a stage
+    for (stage_metrics const& m : result) {
+      total.perf[c] += m.perf[c];
+    }
+  }
+  for (int c = 0; c < N_OP_COUNTERS; c++) {
+    total.ops[c] = 0;
+    for (stage_metrics const& m : result) {
+      total.ops[c] = OpCounters::isMax(c) ? max(total.ops[c], m.ops[c])
+                                          : total.ops[c] + m.ops[c];
+    }
+  }
+  result.push_back(total);
+  return result;
+}
+
+static double itemsPerSecond(stage_metrics const& m) {
+  return (m.wall_ms > 0) ? m.items / (m.wall_ms / 1000.0) : 0;
+}
+
+void Metrics::write(string const& filename) {
+  vector<stage_metrics> all = stages();
+  ofstream out(filename);
+  if (!out) {
+    throw runtime_error("cannot write metrics to " + filename);
+  }
+  out << fixed << setprecision(3);
+  bool csv = filename.size() >= 4 &&
+             filename.compare(filename.size() - 4, 4, ".csv") == 0;
+  if (csv) {
+    out << "stage,wall_ms,cpu_ms,child_cpu_ms,peak_rss_kb,rss_kb,"
+        << "tracked_kb,tracked_peak_kb,items,item_unit,items_per_s";
+    for (int c = 0; c < N_PERF_COUNTERS; c++) {
+      out << "," << PerfCounters::name(c);
+    }
+    for (int c = 0; c < N_OP_COUNTERS; c++) {
+      out << "," << OpCounters::name(c);
+    }
+    out << endl;
+    for (stage_metrics const& m : all) {
+      out << m.name << "," << m.wall_ms << "," << m.cpu_ms << ","
+          << m.child_cpu_ms << "," << m.peak_rss_kb << "," << m.rss_kb << ","
+          << m.tracked_kb << "," << m.tracked_peak_kb << ","
+          << m.items << "," << m.item_unit << "," << itemsPerSecond(m);
+      for (int c = 0; c < N_PERF_COUNTERS; c++) {
+        out << ",";               // empty if not counted
+        if (m.perf[c] >= 0) out << m.perf[c];
+      }
+      for (int c = 0; c < N_OP_COUNTERS; c++) {
+        out << "," << m.ops[c];
+      }
+      out << endl;
+    }
+  }
+  else {
+    out << "{\"stages\": [" << endl;
+    for (unsigned int s = 0; s < all.size(); s++) {
+      stage_metrics const& m = all[s];
+      out << "  {\"stage\": \"" << m.name << "\", "
+          << "\"wall_ms\": " << m.wall_ms << ", "
+          << "\"cpu_ms\": " << m.cpu_ms << ", "
+          << "\"child_cpu_ms\": " << m.child_cpu_ms << ", "
+          << "\"peak_rss_kb\": " << m.peak_rss_kb << ", "
+          << "\"rss_kb\": " << m.rss_kb << ", "
+          << "\"tracked_kb\": " << m.tracked_kb << ", "
+          << "\"tracked_peak_kb\": " << m.tracked_peak_kb << ", "
+          << "\"items\": " << m.items << ", "
+          << "\"item_unit\": \"" << m.item_unit << "\", "
+          << "\"items_per_s\": " << itemsPerSecond(m);
+      for (int c = 0; c < N_PERF_COUNTERS; c++) {
+        out << ", \"" << PerfCounters::name(c) << "\": ";
+        if (m.perf[c] >= 0) out << m.perf[c];
+        else out << "null";       // not counted
+      }
+      for (int c = 0; c < N_OP_COUNTERS; c++) {
+        out << ", \"" << OpCounters::name(c) << "\": " << m.ops[c];
+      }
+      out << "}" << (s + 1 < all.size() ? "," : "") << endl;
+    }
+    out << "]}" << endl;
+  }
+  if (!out) {
+    throw runtime_error("cannot write metrics to " + filename);
+  }
+}
+
+static void printOps(stage_metrics const& m) {
+  // one line of the nonzero operation counts of m, with the work per
+  // call where it can be derived
+  // the counter each counter is also reported per, -1 for none
+  static const int PER[N_OP_COUNTERS] = {
+    -1, OP_LCP_CALLS, -1, OP_SA_SEARCHES, -1, -1, -1, -1, OP_BLOCKS, -1
+  };
+  bool first = true;
+  for (int c = 0; c < N_OP_COUNTERS; c++) {
+    if (m.ops[c] == 0) continue;
+    cout << (first ? "  " : ", ") << OpCounters::name(c) << " " << m.ops[c];
+    first = false;
+    int per = PER[c];
+    if (per >= 0 && m.ops[per] > 0) {
+      cout << " (" << (double) m.ops[c] / m.ops[per] << " per "
+           << OpCounters::name(per) << ")";
+    }
+  }
+  if (!first) cout << endl;
+}
+
+static void printCounters(stage_metrics const& m) {
+  // one line of the counted hardware events of m, with instructions per
+  // cycle and misses per thousand instructions where they can be derived
+  long long instructions = m.perf[PERF_INSTRUCTIONS];
+  bool first = true;
+  for (int c = 0; c < N_PERF_COUNTERS; c++) {
+    if (m.perf[c] < 0) continue;
+    cout << (first ? "  " : ", ") << PerfCounters::name(c) << " "
+         << m.perf[c];
+    first = false;
+    if (c == PERF_INSTRUCTIONS && m.perf[PERF_CYCLES] > 0) {
+      cout << " (" << (double) instructions / m.perf[PERF_CYCLES]
+           << " per cycle)";
+    }
+    else if (c != PERF_CYCLES && c != PERF_INSTRUCTIONS && instructions > 0) {
+      cout << " (" << 1000.0 * m.perf[c] / instructions << " per kinstr)";
+    }
+  }
+  if (!first) cout << endl;
+}
+
+void Metrics::printSummary() {
+  cout << fixed << setprecision(2);
+  for (stage_metrics const& m : stages()) {
+    cout << "Stage " << m.name << ": "
+         << m.wall_ms / 1000 << "s wall, "
+         << m.cpu_ms / 1000 << "s cpu, ";
+    if (m.child_cpu_ms > 0) {
+      cout << m.child_cpu_ms / 1000 << "s child cpu, ";
+    }
+    cout << m.peak_rss_kb / 1024 << "MB peak rss";
+    if (m.items > 0) {
+      cout << ", " << (unsigned long) itemsPerSecond(m) << " "
+           << m.item_unit << "/s";
+    }
+    cout << endl;
+    printOps(m);
+    printCounters(m);
+  }
+  cout.unsetf(ios::floatfield);
+  cout << setprecision(6);
+}
@@ -0,0 +1,99 @@
+// Metrics.h
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "PerfCounters.h"
+#include "OpCounters.h"
+
+struct stage_metrics {
+  std::string name;
+  double wall_ms;            // from start to end of the stage
+  double cpu_ms;             // cpu time of GeDi threads working for it
+  double child_cpu_ms;       // cpu time of processes it waited on
+  long peak_rss_kb;          // process peak rss when the stage ended
+  long rss_kb;               // process rss when the stage ended
+  long tracked_kb;           // MemoryTracker live total when it ended
+  long tracked_peak_kb;      // MemoryTracker peak total when it ended
+  unsigned long items;       // items processed, e.g. reads
+  std::string item_unit;     // what items counts
+  long long perf[N_PERF_COUNTERS];  // hardware counts of GeDi threads
+                                    // working for it, -1 if not counted
+  unsigned long long ops[N_OP_COUNTERS];   // OpCounters of its threads
+};
+
+class Metrics {
+  // Process wide record of the wall time, cpu time, memory and
+  // throughput of each pipeline stage. Always on: TaskGraph times every
+  // stage it runs, and stages report the number of items they
+  // processed with setItems().
+  // Stages overlap, so cpu time is charged per thread: a thread's cpu
+  // time counts towards the stage it is currently working for. Pool
+  // tasks work for the stage of the thread that submitted them, so the
+  // time spent on the shared pool is split exactly between stages.
+  // OpCounters, and hardware counts once PerfCounters are enabled, are
+  // charged to stages the same way.
+
+public:
+  static Metrics & global();
+
+  int beginStage(std::string const& name);
+  // Starts recording stage name, returning its id. The calling thread
+  // works for the stage until endStage()
+  void endStage(int stage);
+
+  void setItems(std::string const& stage, unsigned long items,
+                std::string const& unit);
+  // Sets the item count of the stage named stage
+
+  std::vector<stage_metrics> stages();
+  // Records of the finished stages, in order of starting. A final
+  // "total" record covers the whole process
+
+  void write(std::string const& filename);
+  // Writes stages() to filename, as csv if filename ends in .csv,
+  // otherwise as json. Throws runtime_error if it cannot be written.
+
+  void printSummary();
+  // prints one line per stage to cout
+
+  std::string stageName(int stage);
+  // the name of the stage with id stage
+
+  static int currentStage();
+  // the stage the calling thread works for, -1 if none
+  static int enterStage(int stage);
+  // The calling thread works for stage from now on. Returns the stage
+  // it worked for before, to be passed to leaveStage()
+  static void leaveStage(int previous);
+
+private:
+  static const int MAX_STAGES = 64;
+
+  struct stage_record {
+    stage_metrics m;
+    std::chrono::steady_clock::time_point start;
+    double child_cpu_start;
+    bool done;
+  };
+
+  std::mutex lock;
+  std::vector<stage_record> records;
+  std::atomic<long long> cpu_ns[MAX_STAGES];
+  std::atomic<long long> perf_counts[MAX_STAGES][N_PERF_COUNTERS];
+  std::atomic<unsigned long long> op_counts[MAX_STAGES][N_OP_COUNTERS];
+  std::chrono::steady_clock::time_point process_start;
+
+  Metrics();
+  static void chargeThread();
+  // adds the cpu time, operation and hardware counts of the calling
+  // thread since its last charge to the stage it works for
+  static void mergeOps(int stage, unsigned long long ops[N_OP_COUNTERS]);
+};
+
+#endif
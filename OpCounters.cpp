@@ -0,0 +1,28 @@
+// OpCounters.cpp
+#include "OpCounters.h"
+
+static const char *NAMES[N_OP_COUNTERS] = {
+  "lcp_calls",
+  "lcp_chars",
+  "sa_searches",
+  "search_probes",
+  "suffixes_visited",
+  "block_inserts",
+  "block_inserts_added",
+  "blocks",
+  "block_tags",
+  "max_block_tags",
+};
+
+thread_local unsigned long long OpCounters::counts[N_OP_COUNTERS];
+
+const char * OpCounters::name(int counter) {
+  return NAMES[counter];
+}
+
+void OpCounters::take(unsigned long long taken[N_OP_COUNTERS]) {
+  for (int c = 0; c < N_OP_COUNTERS; c++) {
+    taken[c] = counts[c];
+    counts[c] = 0;
+  }
+}
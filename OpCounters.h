@@ -0,0 +1,49 @@
+// OpCounters.h
+#ifndef OPCOUNTERS_H
+#define OPCOUNTERS_H
+
+enum op_counter {
+  OP_LCP_CALLS,             // lcpKernel() calls
+  OP_LCP_CHARS,             // characters compared by lcpKernel()
+  OP_SA_SEARCHES,           // binary searches of GSA1 for a sequence
+  OP_SEARCH_PROBES,         // suffixes compared by those searches
+  OP_SUFFIXES_VISITED,      // suffixes walked to extend blocks
+  OP_BLOCK_INSERTS,         // bp_block::insert() calls
+  OP_BLOCK_INSERTS_ADDED,   // of which added a tag
+  OP_BLOCKS,                // blocks extended for consensus
+  OP_BLOCK_TAGS,            // total tags of the extended blocks
+  OP_MAX_BLOCK_TAGS,        // tags of the largest extended block
+  N_OP_COUNTERS
+};
+
+class OpCounters {
+  // Counts of the basic operations of the hot paths, to tell doing more
+  // work from doing the same work more slowly. Each thread counts into
+  // its own plain array, so counting costs an increment and never
+  // shares a cache line. Metrics takes the counts of a thread whenever
+  // it charges the thread's cpu time, and merges them into the stage
+  // the thread worked for.
+
+public:
+  static void add(op_counter counter, unsigned long long n = 1) {
+    counts[counter] += n;
+  }
+  static void max(op_counter counter, unsigned long long n) {
+    if (n > counts[counter]) counts[counter] = n;
+  }
+  // counters named MAX_ keep the largest value seen, the others a sum
+
+  static bool isMax(int counter) {
+    return counter == OP_MAX_BLOCK_TAGS;
+  }
+  static const char * name(int counter);
+  // the name of counter, as used in reports
+
+  static void take(unsigned long long taken[N_OP_COUNTERS]);
+  // moves the counts of the calling thread into taken, zeroing them
+
+private:
+  static thread_local unsigned long long counts[N_OP_COUNTERS];
+};
+
+#endif
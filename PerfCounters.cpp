@@ -0,0 +1,114 @@
+// PerfCounters.cpp
+#include <string>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "PerfCounters.h"
+
+using namespace std;
+
+struct perf_event_spec {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+};
+
+static const perf_event_spec EVENTS[N_PERF_COUNTERS] = {
+  {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {"llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+  {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  {"dtlb_misses", PERF_TYPE_HW_CACHE,
+   PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+};
+
+std::atomic<bool> PerfCounters::on(false);
+static bool event_available[N_PERF_COUNTERS];
+
+static int openEvent(perf_event_spec const& spec) {
+  // counts the calling thread on any cpu, in user space only
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = spec.type;
+  attr.config = spec.config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+struct thread_counters {
+  // The counters of one thread, closed when the thread exits.
+  // Counters are separate events rather than a group, so the kernel
+  // can multiplex them one by one when there are too few PMU registers.
+  int fds[N_PERF_COUNTERS];
+
+  thread_counters() {
+    for (int c = 0; c < N_PERF_COUNTERS; c++) {
+      fds[c] = event_available[c] ? openEvent(EVENTS[c]) : -1;
+    }
+  }
+  ~thread_counters() {
+    for (int fd : fds) {
+      if (fd >= 0) close(fd);
+    }
+  }
+};
+
+void PerfCounters::enable() {
+  string unavailable;
+  string reason;
+  for (int c = 0; c < N_PERF_COUNTERS; c++) {
+    int fd = openEvent(EVENTS[c]);
+    event_available[c] = (fd >= 0);
+    if (fd >= 0) {
+      close(fd);
+      continue;
+    }
+    unavailable += string(unavailable.empty() ? "" : ", ") + EVENTS[c].name;
+    reason = strerror(errno);
+  }
+  if (!unavailable.empty()) {
+    cout << "Perf counters not available: " << unavailable << " ("
+         << reason << "). Check kernel.perf_event_paranoid, or that the "
+         << "cpu exposes them to this machine." << endl;
+  }
+  on.store(true);
+}
+
+bool PerfCounters::available(int counter) {
+  return event_available[counter];
+}
+
+const char * PerfCounters::name(int counter) {
+  return EVENTS[counter].name;
+}
+
+void PerfCounters::read(long long counts[N_PERF_COUNTERS]) {
+  static thread_local thread_counters counters;
+  for (int c = 0; c < N_PERF_COUNTERS; c++) {
+    counts[c] = -1;
+    if (counters.fds[c] < 0) continue;
+    uint64_t value[3];       // count, time enabled, time running
+    if (::read(counters.fds[c], value, sizeof(value)) != sizeof(value)) {
+      continue;
+    }
+    if (value[2] == 0) {
+      counts[c] = 0;         // not scheduled yet
+    }
+    else if (value[2] < value[1]) {
+      counts[c] = (long long) ((double) value[0] * value[1] / value[2]);
+    }
+    else {
+      counts[c] = value[0];
+    }
+  }
+}
@@ -0,0 +1,47 @@
+// PerfCounters.h
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <string>
+#include <atomic>
+
+enum perf_counter {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_LLC_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_DTLB_MISSES,
+  N_PERF_COUNTERS
+};
+
+class PerfCounters {
+  // Opt in hardware counters of the calling thread, from
+  // perf_event_open(2). Each thread opens its own counters on its first
+  // read(), counting user space only. Counters the kernel refuses (no
+  // PMU in a VM, perf_event_paranoid too high, no such event on this
+  // cpu) are left out, so GeDi runs the same with some, or none, of
+  // them. Counts are scaled up when the kernel had to multiplex them.
+
+public:
+  static void enable();
+  // Opens the counters on the calling thread to find which are
+  // available, and reports to cout any that are not. Counting starts
+  // only after this.
+  static bool enabled() {
+    return on.load(std::memory_order_relaxed);
+  }
+
+  static bool available(int counter);
+  // true if counter could be opened by enable()
+  static const char * name(int counter);
+  // the name of counter, as used in reports
+
+  static void read(long long counts[N_PERF_COUNTERS]);
+  // Sets counts to the totals of the calling thread since its counters
+  // were opened, or to -1 for the counters that are not available.
+
+private:
+  static std::atomic<bool> on;
+};
+
+#endif
@@ -0,0 +1,113 @@
+// PipelineTests.cpp
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "PipelineTests.h"
+#include "SyntheticReads.h"
+#include "BenchSupport.h"
+#include "TaskGraph.h"
+#include "BlockingQueue.h"
+
+using namespace std;
+
+// Error free 100bp reads at 20x over a 20kb genome, per tissue, with a
+// tumour SNV every 500bp
+static const unsigned long GENOME_SEED = 20160601;
+static const unsigned int GENOME_LENGTH = 20000;
+static const unsigned int READ_LENGTH = 100;
+static const unsigned int SNV_SPACING = 500;
+
+static const unsigned int TEST_TIMEOUT = 120;     // seconds
+
+PipelineTests::PipelineTests() {
+  synthetic_options options;
+  options.genome_length = GENOME_LENGTH;
+  options.read_length = READ_LENGTH;
+  options.coverage = SYNTHETIC_COVERAGE;
+  options.snv_spacing = SNV_SPACING;
+  options.seed = GENOME_SEED;
+  options.error_rate = 0;
+  options.n_rate = 0;
+
+  CoutSilencer silence;
+  {
+    SyntheticReads read_set(options, "gedi_test");
+    reads.reset(new ReadsManipulator(1, read_set.inputFile()));
+  }
+  SA.reset(new SuffixArray(*reads, reads->getMinSuffixSize(), 1));
+  BPG.reset(new BranchPointGroups(*SA, *reads, MIN_PHRED, GSA1_MCT,
+      GSA2_MCT, COVERAGE_UPPER_THRESHOLD, 1, MAX_LOW_CONFIDENCE_POS,
+      ECONT, ALLELE_FREQ_OF_ERR));
+}
+
+bool PipelineTests::run() {
+  struct test {
+    string name;
+    bool (PipelineTests::*body)(string &failure);
+  };
+  vector<test> tests = {
+    {"consensusFailureClosesStream",
+     &PipelineTests::consensusFailureClosesStream},
+  };
+
+  bool all_passed = true;
+  for (test const& t : tests) {
+    string failure;
+    alarm(TEST_TIMEOUT);
+    bool passed = (this->*t.body)(failure);
+    alarm(0);
+    cout << (passed ? "PASS " : "FAIL ") << t.name
+         << (passed ? "" : ": " + failure) << endl;
+    all_passed = all_passed && passed;
+  }
+  return all_passed;
+}
+
+bool PipelineTests::consensusFailureClosesStream(string &failure) {
+  if (BPG->SeedBlocks.empty()) {
+    failure = "the read set gave no seed blocks";
+    return false;
+  }
+  // every batch but the first fails, as an allocation would under OOM
+  BPG->before_consensus_batch = [](unsigned int batch) {
+    if (batch > 0) throw runtime_error("injected consensus failure");
+  };
+
+  // the seeds -> consensus -> align streaming of main(), with a
+  // consumer that only drains the stream
+  BlockingQueue<consensus_pair> pair_stream;
+  bool drained = false;
+  TaskGraph pipeline;
+  pipeline.addStage("consensus", {}, [&]() {
+    BPG->buildConsensusPairs(1, &pair_stream);
+  });
+  pipeline.addStage("align", {}, [&]() {
+    consensus_pair pair;
+    while (pair_stream.pop(pair)) {}
+    drained = true;
+  });
+
+  bool rethrown = false;
+  try {
+    CoutSilencer silence;
+    pipeline.run();
+  }
+  catch (runtime_error &e) {
+    rethrown = (string(e.what()) == "injected consensus failure");
+  }
+  BPG->before_consensus_batch = nullptr;
+
+  if (!rethrown) {
+    failure = "pipeline.run() did not rethrow the consensus failure";
+  }
+  else if (!drained) {
+    failure = "the consumer did not see the end of the stream";
+  }
+  else if (BPG->pair_stream != nullptr) {
+    failure = "pair_stream was left set";
+  }
+  return failure.empty();
+}
@@ -0,0 +1,35 @@
+// PipelineTests.h
+#ifndef PIPELINETESTS_H
+#define PIPELINETESTS_H
+
+#include <string>
+#include <memory>
+
+#include "Reads.h"
+#include "SuffixArray.h"
+#include "BranchPointGroups.h"
+
+class PipelineTests {
+  // Tests of how the pipeline stages behave together, run by `make test`.
+  // They run on a small synthetic read set drawn from fixed seeds, built
+  // up to the seed blocks, and reach into the stages as a friend.
+
+public:
+  PipelineTests();
+  // Generates the read set and builds the suffix array and seed blocks
+
+  bool run();
+  // Runs every test, printing PASS or FAIL for each. Returns true if all
+  // passed. A test that hangs is ended by an alarm, failing the run
+
+private:
+  std::unique_ptr<ReadsManipulator> reads;
+  std::unique_ptr<SuffixArray> SA;
+  std::unique_ptr<BranchPointGroups> BPG;
+
+  bool consensusFailureClosesStream(std::string &failure);
+  // A consensus task that throws must close the pair stream, so the
+  // consuming stage finishes and TaskGraph::run() rethrows
+};
+
+#endif
@@ -0,0 +1,95 @@
+// ReadBitmap.h
+#ifndef READBITMAP_H
+#define READBITMAP_H
+
+#include <vector>
+#include <iterator>
+#include <cstddef>
+#include <stdint.h>
+
+class ReadBitmap {
+  // Dense bitvector over read ids, one bit per read. Replaces a
+  // std::set<unsigned int> of read ids, which costs a ~40 byte node and
+  // a log-time insert per read. Iterating yields the ids of set bits in
+  // ascending order, as iterating the set did.
+
+private:
+  std::vector<uint64_t> words;
+  unsigned int n_bits;
+
+public:
+  class const_iterator {
+  public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef unsigned int value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef unsigned int const* pointer;
+    typedef unsigned int reference;
+  private:
+    ReadBitmap const* bitmap;
+    unsigned int pos;
+  public:
+    const_iterator(ReadBitmap const* b, unsigned int p): bitmap(b), pos(p) {}
+    unsigned int operator*() const { return pos; }
+    const_iterator & operator++() { pos = bitmap->next(pos + 1); return *this; }
+    bool operator==(const_iterator const& o) const { return pos == o.pos; }
+    bool operator!=(const_iterator const& o) const { return pos != o.pos; }
+  };
+
+  ReadBitmap(): n_bits(0) {}
+
+  void resize(unsigned int n) {
+    n_bits = n;
+    words.assign((n + 63) / 64, 0);
+  }
+  // Sets the bitmap to hold n bits, all cleared
+
+  void set(unsigned int i) {
+    words[i >> 6] |= (uint64_t(1) << (i & 63));
+  }
+
+  void atomicSet(unsigned int i) {
+    __atomic_fetch_or(&words[i >> 6], uint64_t(1) << (i & 63),
+                      __ATOMIC_RELAXED);
+  }
+  // Thread safe set(). Threads may set bits concurrently, but must be
+  // joined before the bitmap is read.
+
+  bool test(unsigned int i) const {
+    return (words[i >> 6] >> (i & 63)) & 1;
+  }
+
+  unsigned int next(unsigned int i) const {
+    // returns the index of the first set bit >= i, or size() if none
+    if (i >= n_bits) return n_bits;
+    unsigned int w = i >> 6;
+    uint64_t word = words[w] & (~uint64_t(0) << (i & 63));
+    while (word == 0) {
+      if (++w == words.size()) return n_bits;
+      word = words[w];
+    }
+    return (w << 6) + __builtin_ctzll(word);
+  }
+
+  unsigned int count() const {
+    unsigned int c = 0;
+    for (uint64_t word : words) c += __builtin_popcountll(word);
+    return c;
+  }
+  // returns the number of set bits
+
+  bool empty() const {
+    return next(0) == n_bits;
+  }
+
+  unsigned int size() const { return n_bits; }
+  // returns the number of bits (not the number of set bits)
+
+  size_t bytes() const { return words.capacity() * sizeof(uint64_t); }
+  // returns the number of bytes allocated for the bits
+
+  const_iterator begin() const { return const_iterator(this, next(0)); }
+  const_iterator end() const { return const_iterator(this, n_bits); }
+};
+
+#endif
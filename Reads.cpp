@@ -5,10 +5,8 @@
 #include <fstream>
 #include <utility>
 #include <cstring>
+#include <iterator>
 
-// For parallel data processing 
-#include <thread>
-#include <mutex>
 
 #include <zlib.h>   // gunzip parser
 #include "kseq.h"   // fastq parser
@@ -16,6 +14,9 @@
 #include "util_funcs.h"
 #include "string.h" // split_string()
 #include "Reads.h"
+#include "ThreadPool.h"
+#include "MemoryTracker.h"
+#include "Trace.h"
 
 KSEQ_INIT(gzFile, gzread);    // initialize .gz parser
 
@@ -36,7 +37,7 @@ static const string TERM_CHAR = "$";      // suffix termination character
 
 
 ReadsManipulator::ReadsManipulator(int n_threads, string const& inputFile):
-N_THREADS(1){
+N_THREADS(n_threads){
   minimum_suffix_size = MIN_SUFFIX_SIZE;
   distal_trim_len = DISTAL_TRIM;
 
@@ -58,6 +59,12 @@ N_THREADS(1){
 
 //  printRemainingReads("/data/ic711/point1.txt");
 //  printAllReads();
+  MemoryTracker::global().set("read store",
+      MemoryTracker::stringsBytes(HealthyReads) +
+      MemoryTracker::stringsBytes(TumourReads));
+  MemoryTracker::global().set("phreds",
+      MemoryTracker::stringsBytes(HealthyPhreds) +
+      MemoryTracker::stringsBytes(TumourPhreds));
   cout << "End of ReadsManipulator constructor " << endl;
 //  writeContainer(HealthyReads, "/data/ic711/HealthyReads.txt");
 //  writeContainer(TumourReads, "/data/ic711/TumourReads.txt");
@@ -124,6 +131,8 @@ string ReadsManipulator::performDistalTrim(string & s) {
 void ReadsManipulator::loadFastqRawDataFromFile(string filename, 
                               vector<string> &processed_reads, 
                               vector<string> & processed_phreds) {
+  // parsing is serial, the quality filter chunks show as nested spans
+  Trace::Span span("load fastq");
 
   gzFile data_file;
   data_file = gzopen(filename.c_str(), "r");    // open stream to next fastq.gz 
@@ -154,37 +163,29 @@ void ReadsManipulator::loadFastqRawDataFromFile(string filename,
  
 
   // MULTITHREADED SECTION
-  vector<thread> thread_group;                      // set up thread store
-  thread_group.reserve(N_THREADS);
-
+  // Each chunk is processed into its own store. Stores are appended in
+  // chunk order, so reads keep their file order (and so their read ids)
+  // whatever the thread count.
   vector<fastq_t> *fastq_elements_p = &fastq_elements;
-
+  vector<vector<string> > chunk_reads(N_THREADS), chunk_phreds(N_THREADS);
   int elements_per_thread = (fastq_elements.size() / N_THREADS);
-  int from = 0, to = elements_per_thread;
-
-  // run threads...
-  for(int i=0; i < N_THREADS; ++i) {
-    // run thread, processing a chunk of the raw data
-    thread_group.push_back(
-         std::thread(&ReadsManipulator::qualityProcessRawData, this, 
-                     fastq_elements_p, &processed_reads, &processed_phreds, from, to, i));
-
-
-    // set up next chunk
-    from = to;
-    if (i == N_THREADS-1) {// last thread
-      to = fastq_elements.size();
-    }
-    else {
-      to += elements_per_thread;
-    }
-  }
 
-  // wait for threads to finish task, terminating parallel section
-  for (auto &thread : thread_group) {
-    thread.join();
+  ThreadPool::global().parallelFor(N_THREADS, [&](unsigned int i) {
+    int from = i * elements_per_thread;
+    int to = (i == (unsigned int) N_THREADS-1) ? fastq_elements.size() : 
+                                  from + elements_per_thread;
+    qualityProcessRawData(fastq_elements_p, &chunk_reads[i], 
+                          &chunk_phreds[i], from, to, i);
+  }, N_THREADS);
+
+  for (int i=0; i < N_THREADS; i++) {
+    processed_reads.insert(processed_reads.end(), 
+        std::make_move_iterator(chunk_reads[i].begin()),
+        std::make_move_iterator(chunk_reads[i].end()));
+    processed_phreds.insert(processed_phreds.end(), 
+        std::make_move_iterator(chunk_phreds[i].begin()),
+        std::make_move_iterator(chunk_phreds[i].end()));
   }
-
 }
 
 void ReadsManipulator::qualityProcessRawData(vector<fastq_t> *r_data, 
@@ -194,6 +195,7 @@ void ReadsManipulator::qualityProcessRawData(vector<fastq_t> *r_data,
                            int to, int tid){
 
   // from, to define the range this thread will process
+  Trace::Span span("quality filter", "chunk", tid);
   vector<string> readThreadStore;
   vector<string> phredThreadStore;
   readThreadStore.reserve(to - from);
@@ -258,13 +260,9 @@ void ReadsManipulator::qualityProcessRawData(vector<fastq_t> *r_data,
     }
   }
 
-  std::lock_guard<std::mutex> lock(quality_processing_lock); // coordinate threads
-  for (string accepted_read : readThreadStore) {
-    processed_reads->push_back(accepted_read); // load trimmed read
-  }
-  for (string phred : phredThreadStore) {
-    processed_phreds->push_back(phred);
-  }
+  // processed_reads/phreds belong to this chunk alone
+  processed_reads->swap(readThreadStore);
+  processed_phreds->swap(phredThreadStore);
     // Link iterators to string
     //string::iterator left = (*r_data)[i].seq.begin();
     //string::iterator right = (*r_data)[i].seq.begin();
@@ -23,6 +23,7 @@ struct file_and_type {
 class ReadsManipulator{
   // This class stores all the reads for the dataset. 
   // Functions are allowed direct access to reads. 
+  friend class KernelBenchmarks;
 
 private:
   const int N_THREADS;
@@ -32,7 +33,6 @@ private:
   std::vector<std::string> TumourReads;   // Container for cancer dataset 
   std::vector<std::string> HealthyPhreds;  // Read and phred containers correspond by index
   std::vector<std::string> TumourPhreds;
-  std::mutex quality_processing_lock;  // lock for thread copy to H/T.Reads
 
 
   void parseInputFile(std::string const& inputFile, std::vector<file_and_type> &datafiles);
@@ -0,0 +1,272 @@
+// SAEngineBenchmarks.cpp
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "SAEngineBenchmarks.h"
+#include "SyntheticReads.h"
+#include "Reads.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+// Read sets
+static const unsigned long GENOME_SEED = 20160601;
+static const unsigned int READ_LENGTH = 100;
+static const unsigned int COVERAGE = 20;
+static const unsigned int MIN_GENOME_LENGTH = 10 * READ_LENGTH;
+static const unsigned int SNV_SPACING = 1000;
+
+static long long procStatusKb(string const& field) {
+  // field of /proc/self/status, in kB, or -1 if not there
+  ifstream status("/proc/self/status");
+  string line;
+  while (getline(status, line)) {
+    if (line.compare(0, field.size() + 1, field + ":") == 0) {
+      return atoll(line.c_str() + field.size() + 1);
+    }
+  }
+  return -1;
+}
+
+static bool resetPeakRss() {
+  // only the build's own peak is wanted, not the peak of loading reads
+  int fd = open("/proc/self/clear_refs", O_WRONLY);
+  if (fd < 0) return false;
+  bool ok = (write(fd, "5", 1) == 1);
+  close(fd);
+  return ok;
+}
+
+static double cpuSeconds() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static unsigned long long mix(unsigned long long x) {
+  // splitmix64 finalizer
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static string formatBases(unsigned long long bases) {
+  if (bases >= 1000000000ULL && bases % 1000000000ULL == 0) {
+    return to_string(bases / 1000000000ULL) + "G";
+  }
+  if (bases >= 1000000 && bases % 1000000 == 0) {
+    return to_string(bases / 1000000) + "M";
+  }
+  if (bases >= 1000 && bases % 1000 == 0) {
+    return to_string(bases / 1000) + "K";
+  }
+  return to_string(bases);
+}
+
+SAEngineBenchmarks::SAEngineBenchmarks(
+    vector<unsigned long long> const& sizes,
+    vector<sa_engine> const& engines, vector<int> const& thread_counts,
+    unsigned long long max_merge_sort_bases):
+SIZES(sizes),
+ENGINES(engines),
+THREAD_COUNTS(thread_counts),
+MAX_MERGE_SORT_BASES(max_merge_sort_bases) {
+}
+
+bool SAEngineBenchmarks::run() {
+  bool all_ok = true;
+
+  for (unsigned long long bases : SIZES) {
+    // bases / 2 per tissue, at COVERAGE
+    synthetic_options options;
+    options.genome_length = max<unsigned long long>(bases / 2 / COVERAGE,
+                                                    MIN_GENOME_LENGTH);
+    options.read_length = READ_LENGTH;
+    options.coverage = COVERAGE;
+    options.snv_spacing = SNV_SPACING;
+    options.seed = GENOME_SEED;
+    options.error_rate = 0;
+    options.n_rate = 0;
+    cout << "Writing " << formatBases(bases) << " base read set..." << endl;
+    SyntheticReads read_set(options, "gedi_sa_bench");
+    string const& input_file = read_set.inputFile();
+
+    cout << left << setw(8) << "size" << setw(16) << "engine" << right
+         << setw(8) << "threads" << setw(12) << "suffixes"
+         << setw(11) << "seconds" << setw(11) << "cpu s"
+         << setw(9) << "speedup" << setw(12) << "peak MB"
+         << "  digest" << endl;
+
+    bool have_reference = false;
+    sa_run_result reference;
+    map<int, pair<double, sa_engine> > fastest;   // by thread count
+    for (sa_engine engine : ENGINES) {
+      double single_thread_seconds = 0;
+      for (int n_threads : THREAD_COUNTS) {
+        cout << left << setw(8) << formatBases(bases)
+             << setw(16) << SuffixArray::engineName(engine) << right
+             << setw(8) << n_threads;
+        if (engine == SA_MERGE_SORT && bases > MAX_MERGE_SORT_BASES) {
+          cout << "  skipped, over --max-merge-sort "
+               << formatBases(MAX_MERGE_SORT_BASES) << endl;
+          continue;
+        }
+        if (engine == SA_MERGE_SORT && n_threads != THREAD_COUNTS.front()) {
+          cout << "  skipped, single threaded" << endl;
+          continue;
+        }
+        sa_run_result r = runForked(input_file, engine, n_threads);
+        if (!r.ok) {
+          cout << "  failed" << endl;
+          all_ok = false;
+          continue;
+        }
+
+        string agreement = "reference";
+        if (!have_reference) {
+          reference = r;
+          have_reference = true;
+        }
+        else if (r.suffixes == reference.suffixes &&
+                 r.order_digest == reference.order_digest &&
+                 r.set_digest == reference.set_digest) {
+          agreement = "same";
+        }
+        else {
+          agreement = "DIFFERENT";
+          all_ok = false;
+        }
+        if (single_thread_seconds == 0) {
+          single_thread_seconds = r.seconds;
+        }
+        if (fastest.count(n_threads) == 0 ||
+            r.seconds < fastest[n_threads].first) {
+          fastest[n_threads] = make_pair(r.seconds, engine);
+        }
+
+        ostringstream digest;
+        digest << hex << setw(16) << setfill('0') << r.order_digest;
+        cout << setw(12) << r.suffixes << fixed << setprecision(2)
+             << setw(11) << r.seconds << setw(11) << r.cpu_seconds
+             << setw(9) << single_thread_seconds / r.seconds
+             << setprecision(1) << setw(12) << r.peak_kb / 1024.0
+             << "  " << digest.str() << " " << agreement << endl;
+        cout.unsetf(ios::floatfield);
+      }
+    }
+
+    cout << "Fastest for " << formatBases(bases) << " bases:";
+    for (auto const& f : fastest) {
+      cout << " " << SuffixArray::engineName(f.second.second) << " at "
+           << f.first << (f.first == 1 ? " thread;" : " threads;");
+    }
+    cout << endl << endl;
+  }
+  return all_ok;
+}
+
+sa_run_result SAEngineBenchmarks::runForked(string const& input_file,
+                                            sa_engine engine, int n_threads) {
+  sa_run_result result = sa_run_result();
+  int fds[2];
+  if (pipe(fds) != 0) {
+    throw runtime_error("cannot create a pipe");
+  }
+  cout.flush();
+  pid_t pid = fork();
+  if (pid < 0) {
+    throw runtime_error("cannot fork");
+  }
+  if (pid == 0) {
+    // The child has no thread pool yet, so it can safely start its own.
+    // GeDi's progress output goes to /dev/null, errors still show
+    close(fds[0]);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    // An exception must not unwind into the driver's frames, whose
+    // destructors would remove the parent's read set
+    try {
+      sa_run_result r = build(input_file, engine, n_threads);
+      ssize_t written = write(fds[1], &r, sizeof(r));
+      _exit(written == sizeof(r) ? 0 : 1);
+    }
+    catch (exception &e) {
+      cerr << SuffixArray::engineName(engine) << " build failed: "
+           << e.what() << endl;
+      _exit(1);
+    }
+  }
+
+  close(fds[1]);
+  size_t got = 0;
+  while (got < sizeof(result)) {
+    ssize_t n = read(fds[0], (char *) &result + got, sizeof(result) - got);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    got += n;
+  }
+  close(fds[0]);
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+  if (WIFSIGNALED(status)) {
+    cerr << SuffixArray::engineName(engine) << " build was killed by signal "
+         << WTERMSIG(status) << endl;
+  }
+  if (got != sizeof(result) || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0) {
+    result.ok = false;
+  }
+  return result;
+}
+
+sa_run_result SAEngineBenchmarks::build(string const& input_file,
+                                        sa_engine engine, int n_threads) {
+  sa_run_result r = sa_run_result();
+  ThreadPool::init(n_threads, false);
+  ReadsManipulator reads(n_threads, input_file);
+  if (!resetPeakRss()) {
+    cerr << "cannot reset the peak rss, peak MB includes loading reads"
+         << endl;
+  }
+  long long base_kb = procStatusKb("VmRSS");
+
+  double cpu_start = cpuSeconds();
+  auto start = chrono::steady_clock::now();
+  SuffixArray SA(reads, reads.getMinSuffixSize(), n_threads, engine);
+  r.seconds = chrono::duration<double>(
+      chrono::steady_clock::now() - start).count();
+  r.cpu_seconds = cpuSeconds() - cpu_start;
+  r.peak_kb = procStatusKb("VmHWM") - base_kb;
+
+  r.suffixes = SA.getSize();
+  r.order_digest = 14695981039346656037ULL;
+  for (unsigned int i = 0; i < SA.getSize(); i++) {
+    Suffix_t &s = SA.getElem(i);
+    string::iterator it = reads.returnStartIterator(s);
+    string::iterator end = reads.returnEndIterator(s);
+    unsigned long long h = 14695981039346656037ULL;     // FNV-1a
+    for (; it != end; it++) {
+      h = (h ^ (unsigned char) *it) * 1099511628211ULL;
+    }
+    r.order_digest = mix(r.order_digest ^ h);
+    r.set_digest += mix(((unsigned long long) s.type << 48) ^
+                        ((unsigned long long) s.read_id << 16) ^ s.offset);
+  }
+  r.ok = true;
+  return r;
+}
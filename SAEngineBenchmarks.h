@@ -0,0 +1,60 @@
+// SAEngineBenchmarks.h
+#ifndef SAENGINEBENCHMARKS_H
+#define SAENGINEBENCHMARKS_H
+
+#include <string>
+#include <vector>
+
+#include "SuffixArray.h"
+
+struct sa_run_result {
+  // what a forked build reports back to the driver
+  bool ok;
+  double seconds;              // wall time of the SuffixArray constructor
+  double cpu_seconds;          // of the whole process, over the same span
+  long long peak_kb;           // peak rss above the rss with reads loaded
+  unsigned long long suffixes;
+  unsigned long long order_digest;     // of the suffix strings, in SA order
+  unsigned long long set_digest;       // of the (type, read, offset)s
+};
+
+class SAEngineBenchmarks {
+  // Compares the suffix array engines of SuffixArray, built with `make
+  // sa-bench`. For each read set size, writes a synthetic read set (half
+  // healthy, half tumour, 100bp reads from a random genome at 20x) and
+  // builds the GSA from it with each engine at each thread count.
+  // Each build runs in a forked child, so peak rss is the build's own
+  // and a build that runs out of memory or crashes only fails its row.
+  // The engines agree if their digests do. The order digest hashes the
+  // suffix strings in SA order, so it only ignores how suffixes with
+  // equal strings are ordered, which the engines legitimately differ on.
+
+public:
+  SAEngineBenchmarks(std::vector<unsigned long long> const& sizes,
+                     std::vector<sa_engine> const& engines,
+                     std::vector<int> const& thread_counts,
+                     unsigned long long max_merge_sort_bases);
+  // sizes in bases per read set, both tissues together. Merge sort is
+  // quadratic in the worst case and single threaded, so it is only run
+  // on read sets of up to max_merge_sort_bases
+
+  bool run();
+  // Runs and reports all builds. Returns false if any build failed or
+  // disagreed with the first build of its size
+
+private:
+  const std::vector<unsigned long long> SIZES;
+  const std::vector<sa_engine> ENGINES;
+  const std::vector<int> THREAD_COUNTS;
+  const unsigned long long MAX_MERGE_SORT_BASES;
+
+  sa_run_result runForked(std::string const& input_file, sa_engine engine,
+                          int n_threads);
+  // Builds the GSA of input_file in a child process
+
+  static sa_run_result build(std::string const& input_file,
+                             sa_engine engine, int n_threads);
+  // The child's side of runForked()
+};
+
+#endif
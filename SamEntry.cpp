@@ -1,115 +1,124 @@
 #include <string>
 #include <vector>
-#include <map>
-#include <boost/any.hpp> // used to make map with different Value types
+#include <cstring>
 
-#include "string.h"
 #include "SamEntry.h"
+#include "ThreadPool.h"
 
 using namespace std;
 
+static const size_t MIN_PARALLEL_BYTES = 1 << 20;
+static const int PARTS_PER_THREAD = 4;
+static const int MAPQ_FIELD = 4;
 
-// COMPULSORY SAM FIELDS
-const int SamEntry::HDR   = 0;
-const int SamEntry::FLAG  = 1;
-const int SamEntry::RNAME = 2;
-const int SamEntry::POS   = 3;
-const int SamEntry::MAPQ  = 4;
-const int SamEntry::CIGAR = 5;
-const int SamEntry::RNEXT = 6;
-const int SamEntry::PNEXT = 7;
-const int SamEntry::TLEN  = 8;
-const int SamEntry::SEQ   = 9;
-const int SamEntry::QUAL  = 10;
-
-// BWA OPT FIELDS
-const int SamEntry::NM = 11;
-const int SamEntry::MD = 12;
-const int SamEntry::AS = 13;
-const int SamEntry::BC = 14;
-const int SamEntry::X0 = 15;
-const int SamEntry::X1 = 16;
-const int SamEntry::XN = 17;
-const int SamEntry::XM = 18;
-const int SamEntry::XO = 19;
-const int SamEntry::XG = 20;
-const int SamEntry::XT = 21;
-const int SamEntry::XA = 22;
-const int SamEntry::XS = 23;
-const int SamEntry::XF = 24;
-const int SamEntry::XE = 25;
+static void nextField(const char *&p, const char *end, sam_view &field) {
+  // field is the text up to the next tab, or the end of the line.
+  // Past the last field, field is empty.
+  if (p >= end) {
+    field = sam_view(end, 0);
+    return;
+  }
+  const char *tab = (const char*) memchr(p, '\t', end - p);
+  const char *stop = tab ? tab : end;
+  field = sam_view(p, stop - p);
+  p = tab ? tab + 1 : end;
+}
 
-// ICSMuFin FIELDS
-const int SamEntry::LEFT_OHANG = 26;
-const int SamEntry::RIGHT_OHANG = 27;
-const int SamEntry::BLOCK_ID = 28;
+static bool toInt(const char *p, const char *end, int &value) {
+  bool negative = p < end && *p == '-';
+  if (negative) p++;
+  if (p == end) return false;
+  value = 0;
+  for (; p < end; p++) {
+    if (*p < '0' || *p > '9') return false;
+    value = value * 10 + (*p - '0');
+  }
+  if (negative) value = -value;
+  return true;
+}
 
-SamEntry::SamEntry(string const& entry) {
-  vector<string> split_result;
-  split_string(entry, "\t", split_result);
+static bool toInt(sam_view const& field, int &value) {
+  return toInt(field.ptr, field.ptr + field.len, value);
+}
 
-try {
-    string header = split_result[0];  // load header for later parsing
+SamEntry::SamEntry(): flag(0), pos(0), mapq(0), pair_id(0) {}
+
+bool SamEntry::parse(const char *line, const char *end) {
+  sam_view qname, field;
+  const char *p = line;
+  nextField(p, end, qname);
+  nextField(p, end, field);
+  if (!toInt(field, flag)) return false;
+  nextField(p, end, rname);
+  nextField(p, end, field);
+  if (!toInt(field, pos)) return false;
+  nextField(p, end, field);
+  if (!toInt(field, mapq)) return false;
+  nextField(p, end, cigar);
+  nextField(p, end, field);       // RNEXT
+  nextField(p, end, field);       // PNEXT
+  nextField(p, end, field);       // TLEN
+  nextField(p, end, seq);
+  if (seq.len == 0) return false;
+  return toInt(qname, pair_id);       // the read name is the pair_id
+}
 
-    // Load sam fields, then erase from field list
-    for (int i = 1; i < 11; i++) {
-      if (i == FLAG || i == POS || i == MAPQ) {
-        fields[i] = stoi(split_result[i]);
+void SamEntry::parseLines(const char *begin, const char *end,
+                          filter_fn const& keep,
+                          vector<SamEntry> &entries) {
+  const char *line = begin;
+  while (line < end) {
+    const char *eol = (const char*) memchr(line, '\n', end - line);
+    if (eol == NULL) eol = end;
+    if (eol > line && *line != '@') {      // skip past headers
+      // RNAME and MAPQ first, to reject lines cheaply
+      sam_view fields[MAPQ_FIELD + 1];
+      const char *p = line;
+      for (int i = 0; i <= MAPQ_FIELD; i++) {
+        nextField(p, eol, fields[i]);
       }
-      else {
-        fields[i] = split_result[i];
+      int mapq;
+      if (toInt(fields[MAPQ_FIELD], mapq) && keep(fields[2], mapq)) {
+        SamEntry entry;
+        if (entry.parse(line, eol)) {
+          entries.push_back(entry);
+        }
       }
     }
-
-    // parse the fastq header field
-    vector<string> header_subs;
-    // split off the cancer cns
-    split_string(header, "[", header_subs);
-    fields[HDR] = header_subs[0];
-  
-    // cut of the end "]" char
-    header = header_subs[1].substr(0, header_subs[1].length()-1);
-  
-    // split up the remaining fields
-    header_subs.clear();
-    split_string(header, ";", header_subs);
-    fields[LEFT_OHANG] = stoi(header_subs[0]);
-    fields[RIGHT_OHANG] = stoi(header_subs[1]);
-    fields[BLOCK_ID] = stoi(header_subs[2]);
-
-    if (fields.size() > 11) {
-      // extract bwa optional fields
-      split_result.erase(split_result.begin(), split_result.begin() + 11);
-  
-      fields[NM] = startsWith("NM", split_result);
-      fields[MD] = startsWith("MD", split_result);
-      fields[AS] = startsWith("AS", split_result);
-      fields[BC] = startsWith("BC", split_result);
-      fields[X0] = startsWith("X0", split_result);
-      fields[X1] = startsWith("X1", split_result);
-      fields[XN] = startsWith("XN", split_result);
-      fields[XM] = startsWith("XM", split_result);
-      fields[XO] = startsWith("XO", split_result);
-      fields[XG] = startsWith("XG", split_result);
-      fields[XT] = startsWith("XT", split_result);
-      fields[XA] = startsWith("XA", split_result);
-      fields[XS] = startsWith("XS", split_result);
-      fields[XF] = startsWith("XF", split_result);
-      fields[XE] = startsWith("XE", split_result);
-    }
+    line = eol + 1;
   }
-catch(...) {
-  cout << "Exception!!" << endl;
-}
 }
 
-string SamEntry::startsWith(string const& tok, vector<string> const& fields) {
+void SamEntry::parseBuffer(const char *begin, const char *end,
+                           filter_fn const& keep,
+                           vector<SamEntry> &entries, int n_threads) {
+  size_t size = end - begin;
+  if (n_threads <= 1 || size < MIN_PARALLEL_BYTES) {
+    parseLines(begin, end, keep, entries);
+    return;
+  }
+
+  // split into parts starting at line starts
+  unsigned int n_parts = n_threads * PARTS_PER_THREAD;
+  vector<const char*> edges(n_parts + 1);
+  edges[0] = begin;
+  edges[n_parts] = end;
+  for (unsigned int k = 1; k < n_parts; k++) {
+    const char *nominal = begin + size / n_parts * k;
+    if (nominal < edges[k-1]) nominal = edges[k-1];
+    const char *eol = (const char*) memchr(nominal, '\n', end - nominal);
+    edges[k] = eol ? eol + 1 : end;
+  }
 
+  vector< vector<SamEntry> > part_entries(n_parts);
+  ThreadPool::global().parallelFor(n_parts,
+      [&edges, &keep, &part_entries](unsigned int k) {
+    parseLines(edges[k], edges[k+1], keep, part_entries[k]);
+  }, n_threads);
 
-  for (string const& s : fields) {
-    if (tok == s.substr(0, 2)) return s;
+  for (vector<SamEntry> &part : part_entries) {
+    entries.insert(entries.end(), part.begin(), part.end());
   }
-  return "\0";
 }
 
 void SamEntry::snv_push_back(int v) {
@@ -120,10 +129,6 @@ int SamEntry::snvLocSize() { return SNVLocations.size();}
 int SamEntry::snvLocation(int idx) {return SNVLocations[idx];}
 void SamEntry::setSNVLocation(int idx, int val) {SNVLocations[idx] = val;}
 bool SamEntry::containsIndel() {
-  string cigar = get<string>(SamEntry::CIGAR);
-  if (cigar.find('I') || cigar.find('D')) {
-    return true;
-  }
-  return false;
+  return memchr(cigar.ptr, 'I', cigar.len) != NULL ||
+         memchr(cigar.ptr, 'D', cigar.len) != NULL;
 }
-
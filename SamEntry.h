@@ -1,89 +1,66 @@
 #ifndef SAMENTRY_H
 #define SAMENTRY_H
 
-#include <iostream>
 #include <vector>
 #include <string>
-#include <map>
-#include <boost/any.hpp>
+#include <functional>
+
+struct sam_view {
+  // A field of a sam line, pointing into the buffer holding the line.
+  // Only valid while that buffer is.
+  const char *ptr;
+  unsigned int len;
+
+  sam_view(): ptr(NULL), len(0) {}
+  sam_view(const char *p, unsigned int l): ptr(p), len(l) {}
+  sam_view(std::string const& s): ptr(s.data()), len(s.size()) {}
+
+  unsigned int size() const { return len; }
+  char operator[](unsigned int i) const { return ptr[i]; }
+  std::string str() const { return std::string(ptr, len); }
+  bool operator==(std::string const& s) const {
+    return len == s.size() && s.compare(0, len, ptr, len) == 0;
+  }
+  bool operator!=(std::string const& s) const { return !(*this == s); }
+};
 
 class SamEntry {
-  // Class takes a sam entry string from the file,
-  // and extracts the fields. 
+  // Class holds the fields of a sam entry used by GeDi, as views into
+  // the buffer the entry was parsed from. The consensus pair itself is
+  // not part of the entry, it is looked up by pair_id.
   // It also stores the information pertaining to the number
   // mutations idenified in the particular sam entry
 
-  // Fields
 public:
-
   // COMPULSORY SAM FIELDS
-  static const int HDR;  // <int, string> K, V
-  static const int FLAG;  // <int, int> K, V
-  static const int RNAME;  // <int, string> K, V
-  static const int POS;  // <int, int> K, V
-  static const int MAPQ;  // <int, int> K, V
-  static const int CIGAR;  // <int, string> K, V
-  static const int RNEXT;  // <int, string> K, V
-  static const int PNEXT;  // <int, string> K, V
-  static const int TLEN;  // <int, string> K, V
-  static const int SEQ;  // <int, string> K, V
-  static const int QUAL; // <int, string> K, V
-
-  // BWA OPT FIELDS
-  static const int NM;    // <int, string> K, V 
-  static const int MD;    // <int, string> K, V 
-  static const int AS;    // <int, string> K, V 
-  static const int BC;    // <int, string> K, V 
-  static const int X0;    // <int, string> K, V 
-  static const int X1;    // <int, string> K, V 
-  static const int XN;    // <int, string> K, V 
-  static const int XM;    // <int, string> K, V 
-  static const int XO;    // <int, string> K, V 
-  static const int XG;    // <int, string> K, V 
-  static const int XT;    // <int, string> K, V 
-  static const int XA;    // <int, string> K, V 
-
-
-
-  static const int XS;    // <int, string> K, V 
-  static const int XF;    // <int, string> K, V 
-  static const int XE;    // <int, string> K, V 
+  int flag;
+  sam_view rname;
+  int pos;
+  int mapq;
+  sam_view cigar;
+  sam_view seq;
 
   // ICSMuFin FIELDS
-  static const int LEFT_OHANG;   // <int, int> K,V
-  static const int RIGHT_OHANG;  // <int, int> K, V
-  static const int BLOCK_ID;     // <int, int> K, V
-
+  int pair_id;         // read name, the pair_id of the aligned consensus
+                       // pair
 
-  // FUNCTIONS
+  typedef std::function<bool(sam_view const& rname, int mapq)> filter_fn;
 
-  SamEntry(std::string const& entry); // information parsed from this
+  SamEntry();
 
-  // substript access wrapper for fields (map<int, boost::any>)
-  template <typename RT>
-  RT get(int key) {
+  bool parse(const char *line, const char *end);
+  // Parses the sam line [line, end), without the newline. Returns false
+  // if the line is not a well formed GeDi alignment
 
-    try {
-      return boost::any_cast<RT> (fields[key]);
-    }
-    catch(...) {
-      std::cout << "exception occured" << std::endl
-                << "likely a cast to incorrect type, or" << std::endl
-                << "you tried to access an absent key." << std::endl;
-
-    }
-  }
-  
-  template <typename T>
-  void set(int key, T value) {
-    try {
-      fields[key] = value;
-    }
-    catch (...) {
-      std::cout << "exception occured" << std::endl
-                << "likely tried to access an abscent key." << std::endl;
-    }
-  }
+  static void parseBuffer(const char *begin, const char *end,
+                          filter_fn const& keep,
+                          std::vector<SamEntry> &entries, int n_threads);
+  // Appends to entries the alignments in the sam lines of [begin, end)
+  // for which keep(RNAME, MAPQ) is true. Headers are skipped. RNAME and
+  // MAPQ are read before the rest of the line, so rejected lines are
+  // never fully parsed. Large buffers are split at line ends and parsed
+  // on the global thread pool, with at most n_threads workers. Entries
+  // keep the order of their lines, and point into [begin, end).
 
   int snvLocSize();
   // returns the size (number of elements) in the SNVLocations
@@ -96,22 +73,17 @@ public:
   void snv_push_back(int v);
   // wrapper for SNVLocations.push_back(v)
 
-  bool containsIndel(); 
+  bool containsIndel();
   // True if CIGAR contains insertion 'I' or deletion 'D' in string
 
 
 private:
   // Fields
   std::vector<int> SNVLocations; // SNV index relative to QUAL string
-  unsigned int pair_id;          // not sure if this is nec.
-
-  std::map<int, boost::any> fields; // contains all the sam data fields
-                                    // accessed via the static consts
-
-  // FUNCTIONS
-  std::string startsWith(std::string const& tok, std::vector<std::string> const&
-      fields);
-
 
+  static void parseLines(const char *begin, const char *end,
+                         filter_fn const& keep,
+                         std::vector<SamEntry> &entries);
+  // Serial body of parseBuffer()
 };
 #endif
@@ -0,0 +1,71 @@
+// ScanScheduler.cpp
+#include <vector>
+#include <atomic>
+#include <functional>
+#include <limits>
+
+#include "ScanScheduler.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+static const unsigned int MIN_CHUNK_SIZE = 4096;
+static const unsigned int CHUNKS_PER_THREAD = 64;
+
+const unsigned int ScanScheduler::UNSET = numeric_limits<unsigned int>::max();
+
+ScanScheduler::ScanScheduler(unsigned int size, int n_threads,
+                             boundary_fn b):
+SIZE(size),
+N_THREADS(n_threads),
+boundary(b) {
+  n_chunks = N_THREADS * CHUNKS_PER_THREAD;
+  if (SIZE / n_chunks < MIN_CHUNK_SIZE) {
+    n_chunks = SIZE / MIN_CHUNK_SIZE;
+  }
+  if (n_chunks == 0) n_chunks = 1;
+  chunk_size = SIZE / n_chunks;
+
+  vector<atomic<unsigned int> > edges(n_chunks + 1);
+  aligned_edges.swap(edges);
+  for (unsigned int k=0; k <= n_chunks; k++) {
+    aligned_edges[k] = UNSET;
+  }
+  aligned_edges[0] = 0;
+  aligned_edges[n_chunks] = SIZE;
+}
+
+unsigned int ScanScheduler::numChunks() {
+  return n_chunks;
+}
+
+unsigned int ScanScheduler::alignedEdge(unsigned int k) {
+  unsigned int edge = aligned_edges[k];
+  if (edge != UNSET) {
+    return edge;
+  }
+  // Walk forward to the start of the next group. If the walk crosses
+  // the nominal starts of later chunks (a group spanning several
+  // chunks), those chunks align to the same edge, so cache them too.
+  unsigned int pos = k * chunk_size;
+  while (pos < SIZE && !boundary(pos)) {
+    pos++;
+  }
+  for (unsigned int j = k; j < n_chunks && j * chunk_size <= pos; j++) {
+    aligned_edges[j] = pos;
+  }
+  return pos;
+}
+
+void ScanScheduler::run(work_fn work) {
+  // The pool hands chunks to idle workers, so a worker that hits a 
+  // large repeat group does not hold up the others. At most N_THREADS
+  // chunks are processed at once.
+  ThreadPool::global().parallelFor(n_chunks, [this, &work](unsigned int k) {
+    unsigned int from = alignedEdge(k);
+    unsigned int to = alignedEdge(k + 1);
+    if (from < to) {
+      work(k, from, to);
+    }
+  }, N_THREADS);
+}
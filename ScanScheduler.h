@@ -0,0 +1,59 @@
+// ScanScheduler.h
+#ifndef SCANSCHEDULER_H
+#define SCANSCHEDULER_H
+
+#include <vector>
+#include <atomic>
+#include <functional>
+
+class ScanScheduler {
+  // Schedules a linear scan over a suffix array (or any array that is
+  // partitioned into groups of contiguous elements) on worker threads.
+  // The array is cut into many more chunks than there are threads, and
+  // the chunks are run on the ThreadPool, so a thread that hits a large
+  // repeat group does not hold up the others.
+  // Chunk edges are moved forward to the next group boundary, so
+  // no group is ever split between two chunks. Adjacent chunks agree on
+  // their shared edge, so every element is scanned exactly once.
+
+public:
+  typedef std::function<bool(unsigned int)> boundary_fn;
+  // boundary(i) returns true if a group starts at i, i.e. element i
+  // does not belong to the group of element i-1. For suffix arrays
+  // this is lcp(i-1, i) < min suffix size.
+
+  typedef std::function<void(unsigned int chunk, unsigned int from,
+                             unsigned int to)> work_fn;
+  // Processes the elements [from, to) of chunk. from and to are group
+  // boundaries (or 0 / size). Empty chunks are not passed to work.
+
+  ScanScheduler(unsigned int size, int n_threads, boundary_fn boundary);
+
+  void run(work_fn work);
+  // Runs work over every chunk, at most n_threads chunks at once,
+  // returning once all chunks have been processed.
+
+  unsigned int numChunks();
+  // returns the number of chunks. Chunk indices passed to work are in
+  // [0, numChunks()) and increase along the array, so per-chunk results
+  // can be concatenated in array order.
+
+private:
+  static const unsigned int UNSET;
+
+  const unsigned int SIZE;
+  const int N_THREADS;
+  unsigned int chunk_size;
+  unsigned int n_chunks;
+  boundary_fn boundary;
+  std::vector<std::atomic<unsigned int> > aligned_edges;
+  // aligned_edges[k] caches the group aligned start of chunk k, as
+  // neighbouring chunks both need it
+
+
+  unsigned int alignedEdge(unsigned int k);
+  // returns the first group boundary at or after the nominal start of
+  // chunk k
+};
+
+#endif
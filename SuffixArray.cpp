@@ -20,7 +20,10 @@
 #include "Suffix_t.h"
 #include "util_funcs.h"
 #include "SuffixArray.h"
+#include "ThreadPool.h"
 #include "Reads.h"
+#include "MemoryTracker.h"
+#include "Trace.h"
 
 #include "benchmark.h"
 
@@ -36,15 +39,32 @@ static const int NUM_FIELDS = 3;
 static const string EXT = ".gsa";
 
 
+static const char *ENGINE_NAMES[N_SA_ENGINES] = {
+  "parallel_radix",
+  "merge_radix",
+  "merge_sort",
+};
+
+
 SuffixArray::SuffixArray(ReadsManipulator &reads, int min_suffix, 
-                         int n_threads):
+                         int n_threads, sa_engine engine):
 N_THREADS(n_threads),
 MIN_SUFFIX(min_suffix) {
   cout << "MIN SUFFIX " << (int) min_suffix << endl;
   this->reads = &reads;      // store reads location
-  cout << "Starting parallelGenRadixSA:" << endl;
-
-  parallelGenRadixSA(min_suffix);
+  cout << "Starting " << engineName(engine) << " SA construction:" << endl;
+
+  switch (engine) {
+    case SA_MERGE_RADIX:
+      constructTotalRadixSA();
+      break;
+    case SA_MERGE_SORT:
+      loadUnsortedSuffixes();
+      lexMergeSort();
+      break;
+    default:
+      parallelGenRadixSA(min_suffix);
+  }
   
 //  printReadsInGSA("/data/ic711/point2.txt");
 }
@@ -53,6 +73,10 @@ MIN_SUFFIX(min_suffix) {
 SuffixArray::~SuffixArray() {
 }
 
+const char * SuffixArray::engineName(int engine) {
+  return ENGINE_NAMES[engine];
+}
+
 void SuffixArray::printReadsInGSA(std::string const& filename) {
   ofstream ofHandle(filename.c_str());
 
@@ -69,8 +93,6 @@ void SuffixArray::printReadsInGSA(std::string const& filename) {
 
 void SuffixArray::parallelGenRadixSA(int min_suffix) {
 
-  vector<thread> BSA_and_SA;
-
   unsigned long long *radixSA;   // suffix array pointer
   unsigned int startOfTumour; // int marking start of tumour reads in concat
   unsigned int radixSASize;
@@ -80,25 +102,20 @@ void SuffixArray::parallelGenRadixSA(int min_suffix) {
   vector<pair<unsigned int, unsigned int> > healthyBSA;
   vector<pair<unsigned int, unsigned int> > tumourBSA;
 
-  BSA_and_SA.push_back (
-      std::thread(&SuffixArray::buildBinarySearchArrays, this, &healthyBSA, &tumourBSA)
-      );
-
-  BSA_and_SA.push_back (
-      std::thread(&SuffixArray::generateParallelRadix, this, &radixSA, 
-        &startOfTumour, &radixSASize)
-      );
-
-  for(auto &thread : BSA_and_SA) { 
-    thread.join();
-  }
+  TaskGroup BSA_and_SA(ThreadPool::global());
+  BSA_and_SA.run([&]() {
+    buildBinarySearchArrays(&healthyBSA, &tumourBSA);
+  });
+  BSA_and_SA.run([&]() {
+    generateParallelRadix(&radixSA, &startOfTumour, &radixSASize);
+  });
+  BSA_and_SA.wait();
 
 
 
 
   // begin parallel suffix array construction
   cout << "radix sa size " << radixSASize << endl;
-  vector<thread> workers;
   vector<vector<Suffix_t>> array_blocks;
   unsigned int elements_per_thread = (radixSASize/N_THREADS);
 
@@ -109,37 +126,35 @@ void SuffixArray::parallelGenRadixSA(int min_suffix) {
     array_blocks.push_back(init);
   }
   
-  unsigned int from=0, to = elements_per_thread;
-  for(unsigned int i=0; i < N_THREADS; i++) {
-    // run worker thread
-    workers.push_back(
-    std::thread(&SuffixArray::transformSuffixArrayBlock, this, &array_blocks[i], 
-        &healthyBSA, &tumourBSA, radixSA, from, to, startOfTumour, min_suffix)
-    );
-    // set up next worker thread
-    from = to;
-    if(i == N_THREADS - 2) {  // set up end chunk for final thread
-      to = radixSASize;
-    }
-    else {
-      to += elements_per_thread;
-    }
-  }
-
-  // wait for workers
-  for(auto &thread : workers) {
-    thread.join();
+  ThreadPool::global().parallelFor(N_THREADS, [&](unsigned int i) {
+    unsigned int from = i * elements_per_thread;
+    unsigned int to = (i == (unsigned int) N_THREADS - 1) ? radixSASize : 
+                                             from + elements_per_thread;
+    Trace::Span span("transform block", "block", i);
+    transformSuffixArrayBlock(&array_blocks[i], &healthyBSA, &tumourBSA,
+        radixSA, from, to, startOfTumour, min_suffix);
+  }, N_THREADS);
+
+  size_t block_bytes = 0;
+  for (vector<Suffix_t> const& block : array_blocks) {
+    block_bytes += MemoryTracker::vectorBytes(block);
   }
+  MemoryTracker::global().set("GSA blocks", block_bytes);
 
   delete radixSA;  // done with suffix array
+  MemoryTracker::global().release("radix SA");
   // Finally, load blocks into final SA in order
+  Trace::Span span("concatenate blocks");
   for(int i=0; i < array_blocks.size(); i++) {
     for(int j=0; j < array_blocks[i].size(); j++) {
       SA.push_back(array_blocks[i][j]);
     }
   }
+  MemoryTracker::global().set("GSA", MemoryTracker::vectorBytes(SA));
 
   SA.shrink_to_fit();
+  MemoryTracker::global().set("GSA", MemoryTracker::vectorBytes(SA));
+  MemoryTracker::global().release("GSA blocks");
 }
 
 void SuffixArray::transformSuffixArrayBlock(vector<Suffix_t> *block, 
@@ -155,8 +170,8 @@ void SuffixArray::transformSuffixArrayBlock(vector<Suffix_t> *block,
         binarySearch(*healthyBSA, radixSA[i]);
       Suffix_t s;
       s.offset = radixSA[i] - read_concat_tup.second;
-      if (reads->getReadByIndex(read_concat_tup.first, HEALTHY).size() - s.offset
-          <= reads->getMinSuffixSize()) { 
+      if (!keepSuffix(reads->getReadByIndex(read_concat_tup.first, 
+                                            HEALTHY).size(), s.offset)) {
         continue;
       }
       else{
@@ -184,8 +199,8 @@ void SuffixArray::transformSuffixArrayBlock(vector<Suffix_t> *block,
 
       Suffix_t s;
       s.offset = (radixSA[i] - startOfTumour) - read_concat_tup.second;
-      if (reads->getReadByIndex(read_concat_tup.first, TUMOUR).size() - s.offset
-          <= reads->getMinSuffixSize()) { 
+      if (!keepSuffix(reads->getReadByIndex(read_concat_tup.first, 
+                                            TUMOUR).size(), s.offset)) {
         continue;
       }
       else{
@@ -225,14 +240,24 @@ void SuffixArray::generateParallelRadix(unsigned long long **radixSA,
   *startOfTumour = concat.size();            // mark the end of healthy seqs 
   concat += concatenateReads(TUMOUR);
   *sizeOfRadixSA = concat.size();
-  // Build SA
-  *radixSA = Radix<unsigned long long>((uchar*) concat.c_str(), concat.size()).build();
+  MemoryTracker::global().set("radix text", 
+                              MemoryTracker::stringBytes(concat));
+  // Build SA. The bucket arrays live as long as radix does.
+  {
+    Radix<unsigned long long> radix((uchar*) concat.c_str(), concat.size());
+    *radixSA = radix.build();
+    MemoryTracker::global().set("radix SA", 
+                                concat.size() * sizeof(unsigned long long));
+    MemoryTracker::global().set("radix buckets", radix.bucketBytes());
+  }
+  MemoryTracker::global().release("radix buckets");
+  MemoryTracker::global().release("radix text");
 }
 
 
 // RADIXSAMERGECONSTRUCTOINFUNCS
 
-void SuffixArray::constructTotalRadixSA(uint8_t min_suffix) {
+void SuffixArray::constructTotalRadixSA() {
 
   // local suffix arrays
   vector<Suffix_t> healthy_SA;
@@ -240,26 +265,20 @@ void SuffixArray::constructTotalRadixSA(uint8_t min_suffix) {
 
   // buill local suffix arrays in parallel
 
-  vector<thread> tissue_SA_threads;
+  TaskGroup tissue_SA_tasks(ThreadPool::global());
 
-  // thread for healthy 
-  tissue_SA_threads.push_back(
-      std::thread(&SuffixArray::generalizedRadixSA, this,
-                  &healthy_SA, 
-                  HEALTHY, min_suffix)
-      );
+  // task for healthy 
+  tissue_SA_tasks.run([&]() {
+    generalizedRadixSA(&healthy_SA, HEALTHY);
+  });
  
-  // thread for tumour
-  tissue_SA_threads.push_back(
-      std::thread(&SuffixArray::generalizedRadixSA, this,
-        &tumour_SA, 
-        TUMOUR, min_suffix)
-      );
-
-  // wait for threads to finish
-  for(auto &thread : tissue_SA_threads) {
-    thread.join();
-  }
+  // task for tumour
+  tissue_SA_tasks.run([&]() {
+    generalizedRadixSA(&tumour_SA, TUMOUR);
+  });
+
+  // wait for tasks to finish
+  tissue_SA_tasks.wait();
 
 
 
@@ -324,8 +343,7 @@ void SuffixArray::constructTotalRadixSA(uint8_t min_suffix) {
 
 }
 
-void SuffixArray::generalizedRadixSA(vector<Suffix_t> *TissueSA, bool type,
-    uint8_t min_suf) {
+void SuffixArray::generalizedRadixSA(vector<Suffix_t> *TissueSA, bool type) {
 
   // concatenate all reads to one giant read
   string concat = concatenateReads(type);
@@ -362,9 +380,9 @@ void SuffixArray::generalizedRadixSA(vector<Suffix_t> *TissueSA, bool type,
 
 
 
-    // suffixes with length >= 30 only
-    if((SA[i] - read_concat_tup.second) <=
-        (reads->getReadByIndex(read_concat_tup.first, type).size() - min_suf)) {
+    // suffixes longer than MIN_SUFFIX only
+    if(keepSuffix(reads->getReadByIndex(read_concat_tup.first, type).size(),
+                  SA[i] - read_concat_tup.second)) {
       Suffix_t s;
       s.read_id = read_concat_tup.first;
       s.offset = SA[i] - read_concat_tup.second; 
@@ -569,19 +587,18 @@ void SuffixArray::lexMergeSort() {
 
 
 
-void SuffixArray::loadUnsortedSuffixes(uint8_t min_suffix) {
+void SuffixArray::loadUnsortedSuffixes() {
 
-    // Read length is ~100 bp, and stoping at 100 - min_suffix
+    // Read length is ~100 bp, and stoping at 100 - MIN_SUFFIX
     SA.reserve(    // reserve size for tumour + healthy arrays
-        (reads->getSize(HEALTHY) + reads->getSize(TUMOUR)) * (100 - min_suffix)
+        (reads->getSize(HEALTHY) + reads->getSize(TUMOUR)) * (100 - MIN_SUFFIX)
         ); 
 
   // Loop through each read in HEALTHY set, and add suffixes
   for(unsigned int read_id = 0; read_id < reads->getSize(HEALTHY); read_id++){
 
     for(uint16_t offset = 0; 
-        offset <= (reads->getReadByIndex(read_id, HEALTHY).size() - min_suffix)
-        && offset < reads->getReadByIndex(read_id, HEALTHY).size(); // Safety bounds
+        keepSuffix(reads->getReadByIndex(read_id, HEALTHY).size(), offset);
         offset++) {
 
       // Construct Suffix_t with correct info 
@@ -597,8 +614,7 @@ void SuffixArray::loadUnsortedSuffixes(uint8_t min_suffix) {
   for(unsigned int read_id = 0; read_id < reads->getSize(TUMOUR); read_id++){
 
     for(uint16_t offset = 0; 
-        offset <= (reads->getReadByIndex(read_id, TUMOUR).size() - min_suffix)
-        && offset < reads->getReadByIndex(read_id, TUMOUR).size(); // Safety bounds
+        keepSuffix(reads->getReadByIndex(read_id, TUMOUR).size(), offset);
         offset++) {
 
       // Construct Suffix_t with correct info 
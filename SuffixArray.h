@@ -10,7 +10,16 @@
 #include "Suffix_t.h"
 #include "Reads.h"
 
+enum sa_engine {
+  SA_PARALLEL_RADIX,    // parallelGenRadixSA(): one radixSA over both tissues
+  SA_MERGE_RADIX,       // constructTotalRadixSA(): per tissue, then merged
+  SA_MERGE_SORT,        // loadUnsortedSuffixes() then lexMergeSort()
+  N_SA_ENGINES
+};
+
 class SuffixArray {
+  friend class KernelBenchmarks;
+
 private:
   const int N_THREADS;
   const int MIN_SUFFIX;
@@ -24,6 +33,13 @@ private:
   void constructGSAFromFile(std::vector<Suffix_t> &GSA, std::string filename);
   // Constructs a generalized suffix array from a .gsa
 
+  bool keepSuffix(unsigned int read_size, unsigned int offset) {
+    return read_size - offset > (unsigned int) MIN_SUFFIX;
+  }
+  // Whether the suffix at offset of a read of read_size (with its '$')
+  // goes in the SA. Every engine filters with this, so all build the
+  // same suffixes
+
 
  
   // MERGE SORT FUNCTIONS
@@ -42,7 +58,7 @@ private:
   // lhs is before rhs, false otherwise. 
 
 
-  void loadUnsortedSuffixes(uint8_t min_suffix);
+  void loadUnsortedSuffixes();
   // Function reads through Text (DNA reads) generating a suffix_t for 
   // each suffix of each read, and loads into SA
 
@@ -74,15 +90,14 @@ private:
 
 
   // MERGE_RADIX FUNCTINOS 
-  void constructTotalRadixSA(uint8_t min_suffix);
+  void constructTotalRadixSA();
   // this function uses radixSA from (Sanguthevar Rajasekaran, Marius Nicolae, 
   // 2014). The function contruct in parallel two suffix arrays, 
   // one for each tissue type using radixSA, it then computes a genealizes
   // suffix array using Suffix_t types, then finally
   // merges the two suffix arraus
 
-  void generalizedRadixSA(std::vector<Suffix_t> *TissueSA, 
-      bool type, uint8_t min_suffix);
+  void generalizedRadixSA(std::vector<Suffix_t> *TissueSA, bool type);
   // Function generates tissue specific suffix array using 
   // radixSA and wrapper algorithms to transform to generalized suffix array
   
@@ -102,8 +117,14 @@ private:
   
 
 public:
-  SuffixArray(ReadsManipulator &reads, int min_suffix, int n_threads);
-  // SA constructor builds SA: Loads unsorted suffixes, then sorts.
+  SuffixArray(ReadsManipulator &reads, int min_suffix, int n_threads,
+              sa_engine engine = SA_PARALLEL_RADIX);
+  // SA constructor builds SA with engine. The engines build the same
+  // suffixes in the same order, up to the order of suffixes whose
+  // characters are equal up to and including their '$'
+
+  static const char * engineName(int engine);
+  // the name of engine, as used in reports
 
   ~SuffixArray();
   // Destructor deallocs SA
@@ -0,0 +1,131 @@
+// SyntheticReads.cpp
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "SyntheticReads.h"
+#include "util_funcs.h"
+
+using namespace std;
+
+static const size_t GZ_CHUNK = 1 << 20;
+
+SyntheticReads::SyntheticReads(synthetic_options const& options,
+                               string const& name,
+                               vector<fastq_t> *tumour_reads):
+OPTIONS(options),
+n_reads(options.genome_length * options.coverage / options.read_length) {
+  if (OPTIONS.genome_length < OPTIONS.read_length) {
+    throw runtime_error("the genome is shorter than a read");
+  }
+  string dir_template = "/tmp/" + name + ".XXXXXX";
+  if (mkdtemp(&dir_template[0]) == NULL) {
+    throw runtime_error("cannot create a directory in /tmp");
+  }
+  dir = dir_template;
+
+  try {
+    mt19937_64 rng(OPTIONS.seed);
+    uniform_int_distribution<int> base(0, 3);
+    string genome(OPTIONS.genome_length, 'A');
+    for (char &c : genome) {
+      c = BASES[base(rng)];
+    }
+    string tumour_genome = genome;
+    for (unsigned long long i = OPTIONS.snv_spacing / 2;
+         i < OPTIONS.genome_length; i += OPTIONS.snv_spacing) {
+      tumour_genome[i] = otherBase(genome[i], 1);
+    }
+
+    writeReads(genome, OPTIONS.seed + 1, "healthy", nullptr);
+    writeReads(tumour_genome, OPTIONS.seed + 2, "tumour", tumour_reads);
+
+    input_file = dir + "/inputs.txt";
+    ofstream inputs(input_file);
+    inputs << dir << "/healthy.fastq.gz H" << endl
+           << dir << "/tumour.fastq.gz T" << endl;
+    if (!inputs) {
+      throw runtime_error("cannot write " + input_file);
+    }
+  }
+  catch (...) {
+    removeFiles();
+    throw;
+  }
+}
+
+SyntheticReads::~SyntheticReads() {
+  removeFiles();
+}
+
+void SyntheticReads::removeFiles() {
+  remove((dir + "/healthy.fastq.gz").c_str());
+  remove((dir + "/tumour.fastq.gz").c_str());
+  remove((dir + "/inputs.txt").c_str());
+  rmdir(dir.c_str());
+}
+
+void SyntheticReads::writeReads(string const& genome, unsigned long seed,
+                                string const& name,
+                                vector<fastq_t> *keep) const {
+  const unsigned int read_length = OPTIONS.read_length;
+  const bool exact = (OPTIONS.error_rate == 0 && OPTIONS.n_rate == 0);
+  mt19937_64 rng(seed);
+  uniform_int_distribution<unsigned long long> start(
+      0, genome.size() - read_length);
+  uniform_int_distribution<int> shift(1, 3);
+  uniform_int_distribution<int> good_quality(30, 40);
+  uniform_real_distribution<double> chance(0, 1);
+
+  string filename = dir + "/" + name + ".fastq.gz";
+  gzFile file = gzopen(filename.c_str(), "wb1");
+  if (file == NULL) {
+    throw runtime_error("cannot write " + filename);
+  }
+  string text;
+  fastq_t read;
+  read.qual.assign(read_length, 'I');
+  for (unsigned long long r = 0; r < n_reads; r++) {
+    read.id = name + "_" + to_string(r);
+    read.seq.assign(genome, start(rng), read_length);
+    if (chance(rng) < 0.5) {
+      reverse(read.seq.begin(), read.seq.end());
+      for (char &c : read.seq) c = complementBase(c);
+    }
+    for (unsigned int i = 0; i < read_length && !exact; i++) {
+      // quality drops towards the 3' end
+      int q = good_quality(rng) - (i > read_length * 4 / 5 ? 10 : 0);
+      double p = chance(rng);
+      if (p < OPTIONS.n_rate) {
+        read.seq[i] = 'N';
+        q = 2;
+      }
+      else if (p < OPTIONS.n_rate + OPTIONS.error_rate) {
+        read.seq[i] = otherBase(read.seq[i], shift(rng));
+        q = 8;
+      }
+      read.qual[i] = 33 + q;
+    }
+    text += "@" + read.id + "\n" + read.seq + "\n+\n" + read.qual + "\n";
+    if (keep != nullptr) {
+      keep->push_back(read);
+    }
+    if (text.size() >= GZ_CHUNK || r + 1 == n_reads) {
+      if (gzwrite(file, text.data(), text.size()) != (int) text.size()) {
+        gzclose(file);
+        throw runtime_error("cannot write " + filename);
+      }
+      text.clear();
+    }
+  }
+  if (gzclose(file) != Z_OK) {
+    throw runtime_error("cannot write " + filename);
+  }
+}
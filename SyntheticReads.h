@@ -0,0 +1,62 @@
+// SyntheticReads.h
+#ifndef SYNTHETICREADS_H
+#define SYNTHETICREADS_H
+
+#include <string>
+#include <vector>
+
+#include "Reads.h"
+
+struct synthetic_options {
+  unsigned long long genome_length;
+  unsigned int read_length;
+  unsigned int coverage;         // of each tissue
+  unsigned int snv_spacing;      // a tumour SNV every snv_spacing bases
+  unsigned long seed;            // of the genome. The healthy and tumour
+                                 // reads are drawn from seed + 1, seed + 2
+  double error_rate;             // sequencing errors per base
+  double n_rate;                 // N calls per base
+};
+
+class SyntheticReads {
+  // A healthy and tumour read set drawn from a random genome, for the
+  // benchmarks and tests. Reads come from both strands. The tumour genome
+  // differs from the healthy one by an SNV every snv_spacing bases, the
+  // first at snv_spacing / 2. With error_rate and n_rate both 0 reads are
+  // exact, with quality 'I'. Otherwise qualities are Illumina like, 30 to
+  // 40 dropping by 10 over the last fifth of the read, with errors at
+  // quality 8 and Ns at quality 2. The read set lives in its own directory
+  // in /tmp for as long as the object does.
+
+public:
+  SyntheticReads(synthetic_options const& options, std::string const& name,
+                 std::vector<fastq_t> *tumour_reads = nullptr);
+  // Writes the read set to a new directory /tmp/<name>.XXXXXX, appending
+  // the tumour reads to tumour_reads if given. Throws runtime_error if it
+  // cannot be written, having removed what it wrote
+  ~SyntheticReads();
+  // Removes the read set and its directory
+
+  SyntheticReads(SyntheticReads const&) = delete;
+  SyntheticReads & operator=(SyntheticReads const&) = delete;
+
+  std::string const& inputFile() const { return input_file; }
+  // GeDi input file listing the healthy and tumour fastq.gz files
+
+  unsigned long long readsPerTissue() const { return n_reads; }
+
+private:
+  const synthetic_options OPTIONS;
+  std::string dir;
+  std::string input_file;
+  unsigned long long n_reads;
+
+  void writeReads(std::string const& genome, unsigned long seed,
+                  std::string const& name,
+                  std::vector<fastq_t> *keep) const;
+  // Writes dir/<name>.fastq.gz
+
+  void removeFiles();
+};
+
+#endif
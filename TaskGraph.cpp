@@ -0,0 +1,133 @@
+// TaskGraph.cpp
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+#include <sstream>
+#include <iostream>
+#include <thread>
+
+#include "TaskGraph.h"
+#include "Metrics.h"
+#include "MemoryTracker.h"
+#include "Trace.h"
+
+using namespace std;
+
+TaskGraph::TaskGraph() {
+}
+
+void TaskGraph::addStage(string const& name, vector<string> const& depends_on,
+                         stage_fn fn) {
+  if (stage_index.count(name)) {
+    throw std::invalid_argument("TaskGraph: duplicate stage " + name);
+  }
+  stage s;
+  s.name = name;
+  s.fn = fn;
+  s.n_depends = depends_on.size();
+  unsigned int idx = stages.size();
+  for (string const& dep : depends_on) {
+    map<string, unsigned int>::iterator it = stage_index.find(dep);
+    if (it == stage_index.end()) {
+      throw std::invalid_argument("TaskGraph: stage " + name + 
+                                  " depends on unknown stage " + dep);
+    }
+    stages[it->second].dependents.push_back(idx);
+  }
+  stage_index[name] = idx;
+  stages.push_back(s);
+}
+
+void TaskGraph::runStage(unsigned int s) {
+  int metrics_stage = Metrics::global().beginStage(stages[s].name);
+  int previous = Metrics::enterStage(metrics_stage);
+  Trace::nameThread("stage " + stages[s].name);
+  try {
+    Trace::Span span(stages[s].name.c_str());
+    stages[s].fn();
+  }
+  catch (...) {
+    std::lock_guard<std::mutex> lock(state_lock);
+    if (!failure) failure = std::current_exception();
+  }
+  Metrics::leaveStage(previous);
+  Metrics::global().endStage(metrics_stage);
+  MemoryTracker::global().printStage(stages[s].name);
+  std::lock_guard<std::mutex> lock(state_lock);
+  finished.push_back(s);
+  stage_done.notify_all();
+}
+
+void TaskGraph::run() {
+  vector<unsigned int> waiting_on;      // unfinished dependencies
+  for (stage const& s : stages) {
+    waiting_on.push_back(s.n_depends);
+  }
+  vector<std::thread> running(stages.size());
+  failure = nullptr;
+  finished.clear();
+
+  std::unique_lock<std::mutex> lock(state_lock);
+  unsigned int n_started = 0, n_finished = 0;
+  for (unsigned int s=0; s < stages.size(); s++) {
+    if (waiting_on[s] == 0) {
+      running[s] = std::thread(&TaskGraph::runStage, this, s);
+      n_started++;
+    }
+  }
+  while (n_finished < n_started) {
+    stage_done.wait(lock, [this]() { return !finished.empty(); });
+    vector<unsigned int> done;
+    done.swap(finished);
+    for (unsigned int s : done) {
+      n_finished++;
+      running[s].join();
+      if (failure) continue;
+      for (unsigned int d : stages[s].dependents) {
+        if (--waiting_on[d] == 0) {
+          running[d] = std::thread(&TaskGraph::runStage, this, d);
+          n_started++;
+        }
+      }
+    }
+  }
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+}
+
+map<string, int> TaskGraph::parseStageThreads(string const& spec) {
+  map<string, int> stage_threads;
+  stringstream ss(spec);
+  string item;
+  while (getline(ss, item, ',')) {
+    if (item.empty()) continue;
+    size_t colon = item.find(':');
+    if (colon == string::npos || colon == 0 || colon == item.size() - 1) {
+      throw std::invalid_argument("expected stage:n, got " + item);
+    }
+    int n = 0;
+    for (size_t i = colon + 1; i < item.size(); i++) {
+      if (item[i] < '0' || item[i] > '9') {
+        throw std::invalid_argument("expected stage:n, got " + item);
+      }
+      n = n * 10 + (item[i] - '0');
+    }
+    if (n < 1) {
+      throw std::invalid_argument("stage thread count must be at least 1");
+    }
+    stage_threads[item.substr(0, colon)] = n;
+  }
+  return stage_threads;
+}
+
+int TaskGraph::stageThreads(map<string, int> const& stage_threads,
+                            string const& name, int n_threads) {
+  map<string, int>::const_iterator it = stage_threads.find(name);
+  return (it == stage_threads.end()) ? n_threads : it->second;
+}
@@ -0,0 +1,64 @@
+// TaskGraph.h
+#ifndef TASKGRAPH_H
+#define TASKGRAPH_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+class TaskGraph {
+  // Runs the stages of the pipeline as soon as the stages they depend
+  // on have finished. Independent stages, and stages connected by a 
+  // stream (a BlockingQueue), run at the same time.
+  // A stage body only drives its stage: it runs on its own thread, and
+  // hands its parallel work to the ThreadPool. A stage blocked on a 
+  // stream or an external process therefore never holds a pool worker.
+  // Every stage is recorded in Metrics under its name.
+
+public:
+  typedef std::function<void()> stage_fn;
+
+  TaskGraph();
+
+  void addStage(std::string const& name, 
+                std::vector<std::string> const& depends_on, stage_fn stage);
+  // Adds a stage. depends_on must name stages added before it.
+
+  void run();
+  // Runs every stage, returning once all have finished. If a stage
+  // throws, no further stages are started, and the first exception is
+  // rethrown once the running stages have finished.
+
+  static std::map<std::string, int> parseStageThreads(std::string const& spec);
+  // Parses a per stage thread count list "stage:n,stage:n,..."
+  // Throws std::invalid_argument on malformed input.
+
+  static int stageThreads(std::map<std::string, int> const& stage_threads,
+                          std::string const& name, int n_threads);
+  // returns the thread count given for stage name, or n_threads
+
+private:
+  struct stage {
+    std::string name;
+    stage_fn fn;
+    std::vector<unsigned int> dependents;
+    unsigned int n_depends;
+  };
+
+  std::vector<stage> stages;
+  std::map<std::string, unsigned int> stage_index;
+
+  std::mutex state_lock;
+  std::condition_variable stage_done;
+  std::vector<unsigned int> finished;   // stages finished, not yet handled
+  std::exception_ptr failure;
+
+  void runStage(unsigned int s);
+  // thread function of stage s
+};
+
+#endif
@@ -0,0 +1,218 @@
+// ThreadPool.cpp
+#include <vector>
+#include <string>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <chrono>
+#include <stdexcept>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "ThreadPool.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+using namespace std;
+
+// The pool and index of the worker running on this thread
+static thread_local ThreadPool *current_pool = nullptr;
+static thread_local int current_worker = -1;
+
+unique_ptr<ThreadPool> ThreadPool::process_pool;
+
+ThreadPool::ThreadPool(int n_threads, bool pin_threads): 
+n_queued(0),
+stopping(false),
+pin(pin_threads) {
+  if (n_threads < 1) n_threads = 1;
+  for (int i=0; i <= n_threads; i++) {
+    queues.push_back(unique_ptr<task_queue>(new task_queue));
+  }
+  for (int i=0; i < n_threads; i++) {
+    workers.push_back(std::thread(&ThreadPool::worker, this, i));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(idle_lock);
+    stopping = true;
+  }
+  work_available.notify_all();
+  for (auto &thread : workers) {
+    thread.join();
+  }
+}
+
+void ThreadPool::init(int n_threads, bool pin_threads) {
+  process_pool.reset(new ThreadPool(n_threads, pin_threads));
+}
+
+ThreadPool & ThreadPool::global() {
+  if (!process_pool) {
+    throw std::logic_error("ThreadPool::global() called before init()");
+  }
+  return *process_pool;
+}
+
+int ThreadPool::size() {
+  return workers.size();
+}
+
+int ThreadPool::workerIndex() {
+  return (current_pool == this) ? current_worker : workers.size();
+}
+
+void ThreadPool::submit(task_fn task) {
+  task_queue &queue = *queues[workerIndex()];
+  queued_task queued;
+  queued.fn = std::move(task);
+  queued.stage = Metrics::currentStage();
+  {
+    std::lock_guard<std::mutex> lock(queue.lock);
+    queue.tasks.push_back(std::move(queued));
+  }
+  n_queued++;
+  {
+    // taking idle_lock orders this wake up after the n_queued check of
+    // a worker about to sleep, so the wake up is not lost
+    std::lock_guard<std::mutex> lock(idle_lock);
+  }
+  work_available.notify_one();
+}
+
+bool ThreadPool::runOneTask(int index) {
+  queued_task task;
+  int n = queues.size();
+  // own deque, newest first
+  {
+    task_queue &own = *queues[index];
+    std::lock_guard<std::mutex> lock(own.lock);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+    }
+  }
+  // steal oldest first, starting from the next queue along
+  for (int k = 1; !task.fn && k < n; k++) {
+    task_queue &victim = *queues[(index + k) % n];
+    std::lock_guard<std::mutex> lock(victim.lock);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+    }
+  }
+  if (!task.fn) {
+    return false;
+  }
+  n_queued--;
+  // a worker helping while it waits runs tasks inside another task, so
+  // the stage it worked for is restored after
+  int previous = Metrics::enterStage(task.stage);
+  task.fn();
+  Metrics::leaveStage(previous);
+  return true;
+}
+
+void ThreadPool::worker(int index) {
+  current_pool = this;
+  current_worker = index;
+  Trace::nameThread("worker " + std::to_string(index));
+#ifdef __linux__
+  if (pin) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    unsigned int n_cpus = std::thread::hardware_concurrency();
+    CPU_SET(index % (n_cpus ? n_cpus : 1), &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+  }
+#endif
+  while (true) {
+    if (runOneTask(index)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(idle_lock);
+    work_available.wait(lock, [this]() { return stopping || n_queued > 0; });
+    if (stopping && n_queued == 0) {
+      return;
+    }
+  }
+}
+
+void ThreadPool::parallelFor(unsigned int n, function<void(unsigned int)> fn,
+                             int width) {
+  if (width <= 0 || width > size()) width = size();
+  if ((unsigned int) width > n) width = n;
+  // width runners take indices from a shared counter, so indices are
+  // balanced between runners however long each call takes
+  std::atomic<unsigned int> next(0);
+  TaskGroup group(*this);
+  for (int r=0; r < width; r++) {
+    group.run([&next, &fn, n]() {
+      unsigned int i;
+      while ((i = next++) < n) {
+        fn(i);
+      }
+    });
+  }
+  group.wait();
+}
+
+
+TaskGroup::TaskGroup(ThreadPool &p): pool(&p), pending(0) {
+}
+
+TaskGroup::~TaskGroup() {
+  try {
+    wait();
+  }
+  catch (...) {
+    // the exception was not waited for, so is dropped
+  }
+}
+
+void TaskGroup::run(ThreadPool::task_fn task) {
+  pending++;
+  pool->submit([this, task]() {
+    try {
+      task();
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(done_lock);
+      if (!failure) failure = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock(done_lock);
+    if (--pending == 0) {
+      done.notify_all();
+    }
+  });
+}
+
+void TaskGroup::wait() {
+  int index = pool->workerIndex();
+  if (index < pool->size()) {
+    // a worker helps with queued tasks rather than block its thread
+    while (pending > 0) {
+      if (!pool->runOneTask(index)) {
+        std::unique_lock<std::mutex> lock(done_lock);
+        done.wait_for(lock, std::chrono::microseconds(100),
+                      [this]() { return pending == 0; });
+      }
+    }
+  }
+  std::unique_lock<std::mutex> lock(done_lock);
+  done.wait(lock, [this]() { return pending == 0; });
+  if (failure) {
+    std::exception_ptr e = failure;
+    failure = nullptr;
+    std::rethrow_exception(e);
+  }
+}
@@ -0,0 +1,137 @@
+// ThreadPool.h
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+class ThreadPool {
+  // The process wide pool of worker threads. Every parallel region of
+  // GeDi runs on it, so --n_threads bounds the threads doing work.
+  // Each worker has its own task deque. A worker runs the newest task
+  // of its own deque first, and when that is empty steals the oldest
+  // task of another worker (or of the queue fed by non-worker threads).
+  // A worker waiting on tasks it spawned runs queued tasks meanwhile,
+  // so parallel regions may be nested without deadlock.
+
+public:
+  typedef std::function<void()> task_fn;
+
+  ThreadPool(int n_threads, bool pin_threads = false);
+  // Starts n_threads workers (at least one). If pin_threads, worker i
+  // is bound to cpu i (modulo the number of cpus)
+
+  ~ThreadPool();
+  // Waits for queued tasks to finish, then joins the workers
+
+  static void init(int n_threads, bool pin_threads);
+  // Creates the process wide pool. Must be called before global()
+
+  static ThreadPool & global();
+  // returns the process wide pool
+
+  void submit(task_fn task);
+  // Queues task to run on a worker. Use a TaskGroup to wait for tasks.
+  // The task's cpu time is charged to the Metrics stage the submitting
+  // thread works for
+
+  void parallelFor(unsigned int n, std::function<void(unsigned int)> fn,
+                   int width = 0);
+  // Calls fn(i) for each i in [0, n), returning once all calls have
+  // returned. At most width calls run at once (0: one per worker).
+  // Indices are taken in increasing order. The first exception thrown 
+  // by fn is rethrown.
+
+  int size();
+  // returns the number of workers
+
+  int workerIndex();
+  // returns the index of the calling worker in [0, size()), or size()
+  // if the caller is not a worker of this pool
+
+private:
+  struct queued_task {
+    task_fn fn;
+    int stage;          // Metrics stage of the submitter
+  };
+
+  struct task_queue {
+    std::mutex lock;
+    std::deque<queued_task> tasks;
+  };
+
+  std::vector<std::thread> workers;
+  std::vector<std::unique_ptr<task_queue> > queues;
+  // queues[i] belongs to worker i, queues[size()] takes the tasks
+  // submitted by non-worker threads
+
+  std::atomic<long> n_queued;
+  std::mutex idle_lock;
+  std::condition_variable work_available;
+  bool stopping;
+  bool pin;
+
+  static std::unique_ptr<ThreadPool> process_pool;
+
+  void worker(int index);
+
+  bool runOneTask(int index);
+  // Pops a task (own deque newest first, then steals oldest first) and
+  // runs it. Returns false if no task was found
+
+  friend class TaskGroup;
+};
+
+
+class TaskGroup {
+  // A set of tasks submitted to a pool, that can be waited on together
+  
+public:
+  TaskGroup(ThreadPool &pool);
+  ~TaskGroup();
+  // Waits for the tasks still running
+
+  void run(ThreadPool::task_fn task);
+  // Submits task as part of the group
+
+  void wait();
+  // Returns once every task of the group has finished. A worker thread
+  // runs queued tasks while it waits. Rethrows the first exception
+  // thrown by a task of the group.
+
+private:
+  ThreadPool *pool;
+  std::atomic<unsigned int> pending;
+  std::mutex done_lock;
+  std::condition_variable done;
+  std::exception_ptr failure;
+};
+
+
+template<typename T>
+class WorkerLocal {
+  // One T per worker of a pool, e.g. the scratch buffers of a parallel
+  // region. Buffers are reused by every task a worker runs, so they
+  // keep the capacity they grow to. Non-worker threads share one extra
+  // slot, and so must not call local() concurrently.
+
+public:
+  WorkerLocal(ThreadPool &p): pool(&p), slots(p.size() + 1) {}
+
+  T & local() {
+    return slots[pool->workerIndex()];
+  }
+
+private:
+  ThreadPool *pool;
+  std::vector<T> slots;
+};
+
+#endif
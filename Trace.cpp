@@ -0,0 +1,118 @@
+// Trace.cpp
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "Trace.h"
+
+using namespace std;
+
+struct trace_event {
+  const char *name;
+  const char *arg_name;      // nullptr if the span has no argument
+  long long arg;
+  long long start;           // ns since Trace::enable()
+  long long end;
+};
+
+struct thread_trace {
+  int tid;
+  string name;
+  vector<trace_event> events;
+};
+
+std::atomic<bool> Trace::on(false);
+
+static chrono::steady_clock::time_point origin;
+static std::mutex threads_lock;
+static vector<unique_ptr<thread_trace>> threads;
+static thread_local thread_trace *local = nullptr;
+
+static thread_trace & localTrace() {
+  // the buffer of the calling thread, registered on first use
+  if (local == nullptr) {
+    std::lock_guard<std::mutex> guard(threads_lock);
+    threads.push_back(unique_ptr<thread_trace>(new thread_trace));
+    local = threads.back().get();
+    local->tid = threads.size();
+  }
+  return *local;
+}
+
+static string escaped(string const& s) {
+  string out;
+  for (char c : s) {
+    if (c == '"' || c == '\\') out += '\\';
+    out += c;
+  }
+  return out;
+}
+
+void Trace::enable() {
+  origin = chrono::steady_clock::now();
+  on.store(true);
+}
+
+void Trace::nameThread(string const& name) {
+  localTrace().name = name;
+}
+
+long long Trace::now() {
+  return chrono::duration_cast<chrono::nanoseconds>(
+      chrono::steady_clock::now() - origin).count();
+}
+
+void Trace::record(const char *name, const char *arg_name, long long arg,
+                   long long start, long long end) {
+  trace_event e;
+  e.name = name;
+  e.arg_name = arg_name;
+  e.arg = arg;
+  e.start = start;
+  e.end = end;
+  localTrace().events.push_back(e);
+}
+
+void Trace::write(string const& filename) {
+  ofstream out(filename);
+  if (!out) {
+    throw runtime_error("cannot write trace to " + filename);
+  }
+  std::lock_guard<std::mutex> guard(threads_lock);
+  out << fixed << setprecision(3);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << endl;
+  bool first = true;
+  for (unique_ptr<thread_trace> const& t : threads) {
+    if (!t->name.empty()) {
+      out << (first ? "" : ",\n")
+          << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+          << "\"tid\": " << t->tid << ", \"args\": {\"name\": \""
+          << escaped(t->name) << "\"}}";
+      first = false;
+    }
+    for (trace_event const& e : t->events) {
+      // complete events, timestamps in microseconds
+      out << (first ? "" : ",\n")
+          << "{\"name\": \"" << escaped(e.name) << "\", \"ph\": \"X\", "
+          << "\"pid\": 1, \"tid\": " << t->tid << ", "
+          << "\"ts\": " << e.start / 1000.0 << ", "
+          << "\"dur\": " << (e.end - e.start) / 1000.0;
+      if (e.arg_name != nullptr) {
+        out << ", \"args\": {\"" << escaped(e.arg_name) << "\": " << e.arg
+            << "}";
+      }
+      out << "}";
+      first = false;
+    }
+  }
+  out << "\n]}" << endl;
+  if (!out) {
+    throw runtime_error("cannot write trace to " + filename);
+  }
+}
@@ -0,0 +1,60 @@
+// Trace.h
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <atomic>
+
+class Trace {
+  // Optional timeline of the work each thread does, written as Chrome
+  // trace-event JSON (chrome://tracing, Perfetto) to show load imbalance
+  // between threads. Work is recorded as spans: a Trace::Span times the
+  // scope it lives in, on the thread that created it.
+  // Off by default. While off, a span costs a single relaxed load. While
+  // on, each thread appends to its own buffer, so recording never takes
+  // a lock.
+
+public:
+  static void enable();
+  // starts recording spans. Timestamps are relative to this call
+  static bool enabled() {
+    return on.load(std::memory_order_relaxed);
+  }
+
+  static void nameThread(std::string const& name);
+  // labels the calling thread's row in the timeline
+
+  static void write(std::string const& filename);
+  // Writes all recorded spans to filename. Threads must have finished
+  // their spans. Throws runtime_error if it cannot be written.
+
+  class Span {
+  public:
+    Span(const char *name): Span(name, nullptr, 0) {}
+    Span(const char *name, const char *arg_name, long long arg):
+      name(name), arg_name(arg_name), arg(arg),
+      start(enabled() ? now() : -1) {}
+    // name and arg_name must outlive the trace, e.g. string literals.
+    // arg is shown in the span's details as arg_name
+    ~Span() {
+      if (start >= 0) record(name, arg_name, arg, start, now());
+    }
+
+  private:
+    const char *name;
+    const char *arg_name;
+    long long arg;
+    long long start;         // ns since enable(), -1 if not recording
+  };
+
+private:
+  static std::atomic<bool> on;
+
+  static long long now();
+  // ns since enable()
+  static void record(const char *name, const char *arg_name, long long arg,
+                     long long start, long long end);
+  // appends a span to the calling thread's buffer
+};
+
+#endif
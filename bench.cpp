@@ -0,0 +1,48 @@
+// bench.cpp: runs the kernel microbenchmarks. Built and run by `make bench`
+//   GeDiBench [--reps n] [filter]
+// runs the benchmarks whose names contain filter, n times each
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "KernelBenchmarks.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+static const int DEFAULT_REPETITIONS = 5;
+
+int main(int argc, char **argv) {
+  int repetitions = DEFAULT_REPETITIONS;
+  string filter = "";
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--reps" && i + 1 < argc) {
+      repetitions = atoi(argv[++i]);
+    }
+    else if (arg[0] != '-') {
+      filter = arg;
+    }
+    else {
+      cerr << "usage: " << argv[0] << " [--reps n] [filter]" << endl;
+      return 1;
+    }
+  }
+  if (repetitions < 1) {
+    cerr << "--reps must be at least 1" << endl;
+    return 1;
+  }
+
+  // single threaded, so the timings are of the kernels alone
+  ThreadPool::init(1, false);
+  try {
+    KernelBenchmarks benchmarks(repetitions);
+    benchmarks.run(filter);
+  }
+  catch (exception &e) {
+    cerr << "Benchmark failed: " << e.what() << endl;
+    return 2;
+  }
+  return 0;
+}
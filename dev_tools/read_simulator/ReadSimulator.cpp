@@ -0,0 +1,302 @@
+// ReadSimulator.cpp
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <zlib.h>
+
+#include "ReadSimulator.h"
+#include "../../util_funcs.h"
+#include "../../kseq.h"
+
+KSEQ_INIT(gzFile, gzread);
+
+using namespace std;
+
+static const unsigned long long BATCH_READS = 20000;
+static const int BATCHES_AHEAD = 4;       // per thread, waiting to be written
+static const int MAX_PLACEMENT_TRIES = 1000;
+
+// Qualities, as phred scores. Quality drops over the last fifth of the
+// read, and a base with a sequencing error gets a low score
+static const int MIN_GOOD_PHRED = 30;
+static const int MAX_GOOD_PHRED = 40;
+static const int TAIL_PHRED_DROP = 5;
+static const int ERROR_PHRED = 10;
+static const char PHRED_OFFSET = 33;
+
+ReadSimulator::ReadSimulator(sim_options const& options):
+OPTIONS(options) {
+  loadReference();
+  plantSNVs();
+}
+
+void ReadSimulator::loadReference() {
+  gzFile file = gzopen(OPTIONS.reference.c_str(), "r");
+  if (file == NULL) {
+    throw runtime_error("cannot open " + OPTIONS.reference);
+  }
+  kseq_t *seq = kseq_init(file);
+  genome_length = 0;
+  n_called_bases = 0;
+  while (kseq_read(seq) >= 0) {
+    chromosome chr;
+    chr.name = seq->name.s;
+    chr.seq.assign(seq->seq.s, seq->seq.l);
+    for (char &c : chr.seq) {
+      c = toupper(c);
+      if (strchr(BASES, c) == NULL || c == '\0') {
+        c = 'N';
+      }
+      else {
+        n_called_bases++;
+      }
+    }
+    chromosome_starts.push_back(genome_length);
+    genome_length += chr.seq.size();
+    genome.push_back(move(chr));
+  }
+  kseq_destroy(seq);
+  gzclose(file);
+
+  bool has_room = false;
+  for (chromosome const& chr : genome) {
+    has_room = has_room || chr.seq.size() >= (size_t) OPTIONS.read_length;
+  }
+  if (!has_room || n_called_bases == 0) {
+    throw runtime_error(OPTIONS.reference + " has no sequence as long as "
+                        "a read");
+  }
+}
+
+void ReadSimulator::plantSNVs() {
+  // Gaps between SNVs are geometric, so SNVs are planted independently
+  // at each base. Positions that are 'N' are passed over
+  mt19937_64 rng(OPTIONS.seed);
+  snvs.resize(genome.size());
+  if (OPTIONS.mutation_rate <= 0) return;
+  geometric_distribution<unsigned long long> gap(OPTIONS.mutation_rate);
+  uniform_int_distribution<int> shift(1, 3);
+  for (unsigned int c = 0; c < genome.size(); c++) {
+    string &seq = genome[c].seq;
+    for (unsigned long long pos = gap(rng); pos < seq.size();
+         pos += 1 + gap(rng)) {
+      if (seq[pos] == 'N') continue;
+      planted_snv snv;
+      snv.pos = pos;
+      snv.healthy = seq[pos];
+      snv.tumour = otherBase(seq[pos], shift(rng));
+      snvs[c].push_back(snv);
+    }
+  }
+}
+
+unsigned long long ReadSimulator::nSNVs() {
+  unsigned long long n = 0;
+  for (vector<planted_snv> const& chr_snvs : snvs) {
+    n += chr_snvs.size();
+  }
+  return n;
+}
+
+unsigned long long ReadSimulator::nReads() {
+  return (unsigned long long) (OPTIONS.coverage * n_called_bases /
+                               OPTIONS.read_length);
+}
+
+void ReadSimulator::writeTruth(string const& filename) {
+  ofstream truth(filename);
+  truth << "Type\tChr\tPos\tNormal_NT\tTumor_NT" << endl;
+  for (unsigned int c = 0; c < genome.size(); c++) {
+    for (planted_snv const& snv : snvs[c]) {
+      truth << "SNV\t" << genome[c].name << "\t" << snv.pos + 1 << "\t"
+            << snv.healthy << "\t" << snv.tumour << "\n";
+    }
+  }
+  if (!truth) {
+    throw runtime_error("cannot write " + filename);
+  }
+}
+
+void ReadSimulator::writeReads(bool tumour, string const& filename) {
+  FILE *out = fopen(filename.c_str(), "wb");
+  if (out == NULL) {
+    throw runtime_error("cannot write " + filename);
+  }
+  unsigned long long n_batches = (nReads() + BATCH_READS - 1) / BATCH_READS;
+
+  // Workers take batches in order, and wait while they are too far ahead
+  // of the writer (this thread), which bounds the batches held in memory
+  atomic<unsigned long long> next_batch(0);
+  unsigned long long written = 0;
+  map<unsigned long long, string> done;
+  exception_ptr error;
+  mutex lock;
+  condition_variable changed;
+  unsigned long long window = (unsigned long long) BATCHES_AHEAD *
+                              OPTIONS.n_threads;
+
+  vector<thread> workers;
+  for (int t = 0; t < OPTIONS.n_threads; t++) {
+    workers.emplace_back([&]() {
+      for (;;) {
+        unsigned long long batch = next_batch++;
+        if (batch >= n_batches) return;
+        {
+          unique_lock<mutex> l(lock);
+          changed.wait(l, [&]() { return batch < written + window || error; });
+          if (error) return;
+        }
+        string member;
+        try {
+          member = simulateBatch(tumour, batch);
+        }
+        catch (...) {
+          lock_guard<mutex> l(lock);
+          error = current_exception();
+          changed.notify_all();
+          return;
+        }
+        lock_guard<mutex> l(lock);
+        done[batch] = move(member);
+        changed.notify_all();
+      }
+    });
+  }
+
+  bool write_failed = false;
+  while (written < n_batches) {
+    string member;
+    {
+      unique_lock<mutex> l(lock);
+      changed.wait(l, [&]() { return done.count(written) || error; });
+      if (error) break;
+      member = move(done[written]);
+      done.erase(written);
+    }
+    write_failed = write_failed ||
+        fwrite(member.data(), 1, member.size(), out) != member.size();
+    lock_guard<mutex> l(lock);
+    written++;
+    changed.notify_all();
+  }
+  for (thread &worker : workers) {
+    worker.join();
+  }
+  write_failed = (fclose(out) != 0) || write_failed;
+  if (error) {
+    rethrow_exception(error);
+  }
+  if (write_failed) {
+    throw runtime_error("cannot write " + filename);
+  }
+}
+
+string ReadSimulator::simulateBatch(bool tumour, unsigned long long batch) {
+  seed_seq seeds = {(unsigned int) OPTIONS.seed,
+                    (unsigned int) (OPTIONS.seed >> 32),
+                    (unsigned int) tumour,
+                    (unsigned int) batch, (unsigned int) (batch >> 32)};
+  mt19937_64 rng(seeds);
+
+  unsigned long long first = batch * BATCH_READS;
+  unsigned long long last = min(first + BATCH_READS, nReads());
+  string fastq;
+  fastq.reserve((last - first) * (2 * OPTIONS.read_length + 64));
+  string name, seq, qual;
+  for (unsigned long long r = first; r < last; r++) {
+    simulateRead(tumour, rng, name, seq, qual);
+    fastq += "@";
+    fastq += (tumour ? "t" : "h") + to_string(r) + " " + name + "\n";
+    fastq += seq + "\n+\n" + qual + "\n";
+  }
+
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {       // + 16: gzip header
+    throw runtime_error("cannot initialise zlib");
+  }
+  string member(deflateBound(&z, fastq.size()), '\0');
+  z.next_in = (Bytef *) fastq.data();
+  z.avail_in = fastq.size();
+  z.next_out = (Bytef *) &member[0];
+  z.avail_out = member.size();
+  int status = deflate(&z, Z_FINISH);
+  member.resize(z.total_out);
+  deflateEnd(&z);
+  if (status != Z_STREAM_END) {
+    throw runtime_error("cannot compress reads");
+  }
+  return member;
+}
+
+void ReadSimulator::simulateRead(bool tumour, mt19937_64 &rng, string &name,
+                                 string &seq, string &qual) {
+  const unsigned int L = OPTIONS.read_length;
+  uniform_int_distribution<unsigned long long> position(0, genome_length - 1);
+  uniform_real_distribution<double> chance(0, 1);
+
+  // place the read on the genome, clear of chromosome ends and 'N's
+  unsigned int c;
+  unsigned long long offset;
+  for (int tries = 0; ; tries++) {
+    if (tries == MAX_PLACEMENT_TRIES) {
+      throw runtime_error("cannot place reads on the reference, too few "
+                          "stretches without 'N' as long as a read");
+    }
+    unsigned long long p = position(rng);
+    c = upper_bound(chromosome_starts.begin(), chromosome_starts.end(), p) -
+        chromosome_starts.begin() - 1;
+    offset = p - chromosome_starts[c];
+    if (offset + L <= genome[c].seq.size() &&
+        memchr(genome[c].seq.data() + offset, 'N', L) == NULL) {
+      break;
+    }
+  }
+  seq.assign(genome[c].seq, offset, L);
+
+  // a tumour read is from the mutated haplotype with allele_fraction
+  if (tumour && chance(rng) < OPTIONS.allele_fraction) {
+    vector<planted_snv> const& chr_snvs = snvs[c];
+    auto snv = lower_bound(chr_snvs.begin(), chr_snvs.end(), offset,
+        [](planted_snv const& s, unsigned long long p) { return s.pos < p; });
+    for (; snv != chr_snvs.end() && snv->pos < offset + L; snv++) {
+      seq[snv->pos - offset] = snv->tumour;
+    }
+  }
+
+  bool reverse = chance(rng) < 0.5;
+  if (reverse) {
+    std::reverse(seq.begin(), seq.end());
+    for (char &b : seq) b = complementBase(b);
+  }
+  name = genome[c].name + ":" + to_string(offset + 1) +
+         (reverse ? ":-" : ":+");
+
+  // errors and qualities follow the sequencing cycle, so the read's
+  // own orientation
+  uniform_int_distribution<int> good_phred(MIN_GOOD_PHRED, MAX_GOOD_PHRED);
+  uniform_int_distribution<int> shift(1, 3);
+  qual.resize(L);
+  for (unsigned int i = 0; i < L; i++) {
+    int phred = good_phred(rng) - (i >= L - L / 5 ? TAIL_PHRED_DROP : 0);
+    if (OPTIONS.error_rate > 0 && chance(rng) < OPTIONS.error_rate) {
+      seq[i] = otherBase(seq[i], shift(rng));
+      phred = ERROR_PHRED;
+    }
+    qual[i] = PHRED_OFFSET + phred;
+  }
+}
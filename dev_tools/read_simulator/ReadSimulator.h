@@ -0,0 +1,74 @@
+// ReadSimulator.h
+#ifndef READSIMULATOR_H
+#define READSIMULATOR_H
+
+#include <string>
+#include <vector>
+#include <random>
+
+struct sim_options {
+  std::string reference;        // FASTA, plain or gzipped
+  double coverage;              // of each tissue
+  double mutation_rate;         // planted SNVs per reference base
+  double allele_fraction;       // of tumour reads carrying the SNVs
+  double error_rate;            // sequencing substitutions per base
+  int read_length;
+  unsigned long long seed;
+  int n_threads;
+};
+
+struct chromosome {
+  std::string name;
+  std::string seq;              // upper case, non ACGT bases as 'N'
+};
+
+struct planted_snv {
+  unsigned long long pos;       // 0 based, in its chromosome
+  char healthy;
+  char tumour;
+};
+
+class ReadSimulator {
+  // Simulates single end Illumina like reads of a healthy genome (the
+  // reference) and a tumour genome (the reference with planted SNVs),
+  // for tests of GeDi at controlled sizes and coverages.
+  // Reads are simulated in fixed size batches, each drawn from its own
+  // generator seeded by (seed, tissue, batch), and written in batch order,
+  // so the output depends only on the options, never on n_threads.
+  // Each batch is compressed by the thread that simulated it, as its own
+  // gzip member; concatenated members are a valid gzip file.
+
+public:
+  ReadSimulator(sim_options const& options);
+  // Loads the reference and plants the SNVs
+
+  void writeTruth(std::string const& filename);
+  // Writes the planted SNVs, in the columns of GeDi's SNV_results, with
+  // 1 based positions
+
+  void writeReads(bool tumour, std::string const& filename);
+  // Writes the reads of a tissue as gzipped fastq
+
+  unsigned long long nSNVs();
+  unsigned long long nReads();
+  // reads per tissue
+
+private:
+  const sim_options OPTIONS;
+  std::vector<chromosome> genome;
+  std::vector<unsigned long long> chromosome_starts;   // in the whole genome
+  unsigned long long genome_length;
+  unsigned long long n_called_bases;                  // not 'N'
+  std::vector<std::vector<planted_snv> > snvs;        // by chromosome, sorted
+
+  void loadReference();
+  void plantSNVs();
+
+  std::string simulateBatch(bool tumour, unsigned long long batch);
+  // the gzip member of a batch
+
+  void simulateRead(bool tumour, std::mt19937_64 &rng, std::string &name,
+                    std::string &seq, std::string &qual);
+};
+
+#endif
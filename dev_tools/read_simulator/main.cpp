@@ -0,0 +1,88 @@
+// Simulates healthy and tumour reads of a reference, for scaling tests.
+// Writes <out>_healthy.fastq.gz, <out>_tumour.fastq.gz, the planted SNVs
+// to <out>_truth.tsv, and a GeDi input file listing the reads to
+// <out>_inputs.txt. Built with `make simulator`.
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <cstdlib>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "ReadSimulator.h"
+
+using namespace std;
+
+static void usage(char *exe) {
+  cout << "usage: " << exe << " -r <reference.fa> -o <out prefix>" << endl
+       << "  -c coverage of each tissue           (default 30)" << endl
+       << "  -m SNVs per reference base           (default 0.0001)" << endl
+       << "  -f allele fraction of the SNVs       (default 0.5)" << endl
+       << "  -e sequencing errors per base        (default 0.001)" << endl
+       << "  -l read length                       (default 100)" << endl
+       << "  -s seed                              (default 1)" << endl
+       << "  -t threads                   (default all hardware threads)"
+       << endl;
+}
+
+int main(int argc, char **argv) {
+  sim_options options;
+  options.coverage = 30;
+  options.mutation_rate = 0.0001;
+  options.allele_fraction = 0.5;
+  options.error_rate = 0.001;
+  options.read_length = 100;
+  options.seed = 1;
+  options.n_threads = max(1u, thread::hardware_concurrency());
+  string out_prefix;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "r:o:c:m:f:e:l:s:t:h")) != -1) {
+    switch (opt) {
+      case 'r': options.reference = optarg; break;
+      case 'o': out_prefix = optarg; break;
+      case 'c': options.coverage = atof(optarg); break;
+      case 'm': options.mutation_rate = atof(optarg); break;
+      case 'f': options.allele_fraction = atof(optarg); break;
+      case 'e': options.error_rate = atof(optarg); break;
+      case 'l': options.read_length = atoi(optarg); break;
+      case 's': options.seed = strtoull(optarg, NULL, 10); break;
+      case 't': options.n_threads = atoi(optarg); break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (options.reference.empty() || out_prefix.empty() ||
+      options.coverage <= 0 || options.read_length <= 0 ||
+      options.n_threads <= 0 ||
+      options.mutation_rate < 0 || options.mutation_rate >= 1 ||
+      options.allele_fraction < 0 || options.allele_fraction > 1 ||
+      options.error_rate < 0 || options.error_rate >= 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  try {
+    cout << "Loading " << options.reference << " and planting SNVs..."
+         << endl;
+    ReadSimulator simulator(options);
+    simulator.writeTruth(out_prefix + "_truth.tsv");
+    cout << "Planted " << simulator.nSNVs() << " SNVs" << endl;
+
+    cout << "Writing " << simulator.nReads() << " healthy reads..." << endl;
+    simulator.writeReads(false, out_prefix + "_healthy.fastq.gz");
+    cout << "Writing " << simulator.nReads() << " tumour reads..." << endl;
+    simulator.writeReads(true, out_prefix + "_tumour.fastq.gz");
+
+    ofstream inputs(out_prefix + "_inputs.txt");
+    inputs << out_prefix << "_healthy.fastq.gz,H" << endl
+           << out_prefix << "_tumour.fastq.gz,T" << endl;
+  }
+  catch (exception &e) {
+    cerr << "Simulation failed: " << e.what() << endl;
+    return 2;
+  }
+  return 0;
+}
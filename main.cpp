@@ -1,6 +1,10 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <sstream>
 #include "boost/program_options.hpp"
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -18,6 +22,14 @@
 #include "Reads.h"
 #include "GenomeMapper.h"
 #include "benchmark.h"
+#include "ThreadPool.h"
+#include "TaskGraph.h"
+#include "BlockingQueue.h"
+#include "BwaAligner.h"
+#include "Metrics.h"
+#include "MemoryTracker.h"
+#include "Trace.h"
+#include "PerfCounters.h"
 
 
 using namespace std;
@@ -40,10 +52,28 @@ static const int    MIN_PHRED_QUAL         = 22;
 static const int    MIN_MAPQ               = 42;
 static const double ALLELE_FREQ_OF_ERR     = 0.1; 
 static const string OUTPUT_PATH            = "./"; 
+static const string ALIGNER                = "bowtie2";
 
 
+static bool parseChromosomes(string const& arg, vector<string> &chromosomes) {
+  // "all" gives no chromosomes, meaning every chromosome. Otherwise a
+  // comma separated list, false if any name in it is empty
+  chromosomes.clear();
+  if (arg == "all") {
+    return true;
+  }
+  stringstream list(arg);
+  string chr;
+  while (getline(list, chr, ',')) {
+    if (chr.empty()) return false;
+    chromosomes.push_back(chr);
+  }
+  return !chromosomes.empty() && arg[arg.size()-1] != ',';
+}
+
 int main(int argc, char** argv) 
 { 
+  Metrics::global();    // process start time
   try { 
     namespace po = boost::program_options; 
     po::options_description desc("Options"); 
@@ -80,17 +110,38 @@ int main(int argc, char** argv)
       ("n_threads,t", po::value<int>()->required(), 
        "Number of threads. Integer. Required.\n")
 
+      ("stage_threads", po::value<string>()->default_value(""),
+       "Threads used by individual pipeline stages, overriding --n_threads. Comma separated list of stage:n, with stages reads, sa, seeds, consensus, align and snv. E.g. reads:4,consensus:16\n")
+
+      ("metrics-out", po::value<string>()->default_value(""),
+       "Write the wall time, cpu time, peak rss and throughput of each pipeline stage to this file, as csv if it ends in .csv, otherwise as json.\n")
+
+      ("trace-out", po::value<string>()->default_value(""),
+       "Record a timeline of the work spans of every thread and write it to this file as Chrome trace-event json, for chrome://tracing or Perfetto.\n")
+
+      ("perf-counters", po::bool_switch()->default_value(false),
+       "Count cycles, instructions, LLC, branch and dTLB misses of each pipeline stage with perf_event_open, reported with the stage metrics. Counters the kernel does not permit are skipped.\n")
+
+      ("pin_threads", po::bool_switch()->default_value(false),
+       "Bind each worker thread to its own cpu.\n")
+
       ("chromosome,c", po::value<string>()->required(), 
-       "Target chromosome for SNV calling. Only sam entries with an RNAME = <chromosome> will be extracted from the sam file. Required.")
+       "Target chromosomes for SNV calling, as a comma separated list (chr1,chr2,chrX), or all. Only alignments with an RNAME in the list (any RNAME, for all) are used. Required.\n")
+
+      ("split_by_chromosome", po::bool_switch()->default_value(false),
+       "Write the SNVs of each chromosome to <output_basename>.<chromosome>.SNV_results, instead of all SNVs, sorted by chromosome and position, to <output_basename>.SNV_results.\n")
 
       ("input_files,i", po::value<string>()->required(), 
        "Path and name of file containing the input file list. Required.\n")
 
       ("bt2-idx,x", po::value<string>()->required(), 
-       "Basename of the index for the reference genome. Specified value should be identical to Bowtie2's -x option. Required.\n")
+       "Basename of the index for the reference genome. Specified value should be identical to Bowtie2's -x option, or with --aligner bwa, the basename of the bwa index. Required.\n")
+
+      ("aligner", po::value<string>()->default_value(ALIGNER),
+       "Aligner for the consensus sequences. bowtie2 runs Bowtie2, streaming fastq to it and sam from it over pipes. bowtie2-files runs Bowtie2 over a fastq and sam file written to the output path. bwa aligns in process with bwa mem. Only bowtie2-files writes the fastq and sam.\n")
 
       ("output_basename,o", po::value<string>()->required(), 
-       "Basename for output SNV call file (SNV_results), consensus fastq and sam alignment. Required.\n");
+       "Basename for output SNV call file (SNV_results), and with --aligner bowtie2-files, the consensus fastq and sam alignment. Required.\n");
 
  
     po::variables_map vm; 
@@ -172,6 +223,36 @@ int main(int argc, char** argv)
                   << "Program terminating." << std::endl;
         return ERROR_IN_COMMAND_LINE;
       }
+      try {
+        TaskGraph::parseStageThreads(vm["stage_threads"].as<string>());
+      }
+      catch (std::invalid_argument &e) {
+        std::cerr << "ERROR: " 
+                  << "--stage_threads: " << e.what() << "."
+                  << std::endl << std::endl
+                  << "Refer to --help for input desciption." << std::endl
+                  << "Program terminating." << std::endl;
+        return ERROR_IN_COMMAND_LINE;
+      }
+      if (vm["aligner"].as<string>() != "bowtie2" &&
+          vm["aligner"].as<string>() != "bowtie2-files" &&
+          vm["aligner"].as<string>() != "bwa") {
+        std::cerr << "ERROR: " 
+                  << "--aligner must be bowtie2, bowtie2-files or bwa."
+                  << std::endl << std::endl
+                  << "Refer to --help for input desciption." << std::endl
+                  << "Program terminating." << std::endl;
+        return ERROR_IN_COMMAND_LINE;
+      }
+      vector<string> chromosomes;
+      if (!parseChromosomes(vm["chromosome"].as<string>(), chromosomes)) {
+        std::cerr << "ERROR: " 
+                  << "--chromosome must be all, or a comma separated list of chromosome names."
+                  << std::endl << std::endl
+                  << "Refer to --help for input desciption." << std::endl
+                  << "Program terminating." << std::endl;
+        return ERROR_IN_COMMAND_LINE;
+      }
       if (vm["max_low_confidence_positions"].as<int>() < 0) {
         std::cerr << "ERROR: " 
                   << "--max_low_confidence_positions must be at least 0."
@@ -234,27 +315,114 @@ int main(int argc, char** argv)
       return ERROR_IN_COMMAND_LINE; 
     } 
     // Run GeDi
-    ReadsManipulator reads(vm["n_threads"].as<int>(),
-                           vm["input_files"].as<string>());
+    // Each stage runs once the stages it depends on are done. Consensus pairs stream to the fastq writer as they are built.
+    int n_threads = vm["n_threads"].as<int>();
+    map<string, int> stage_threads = 
+      TaskGraph::parseStageThreads(vm["stage_threads"].as<string>());
 
-    SuffixArray SA(reads, reads.getMinSuffixSize(), vm["n_threads"].as<int>());
+    unique_ptr<ReadsManipulator> reads;
+    unique_ptr<SuffixArray> SA;
+    unique_ptr<BranchPointGroups> BG;
+    unique_ptr<GenomeMapper> mapper;
+    unique_ptr<BwaAligner> aligner;
+    BlockingQueue<consensus_pair> pair_stream;
+    string aligner_name = vm["aligner"].as<string>();
+    vector<string> chromosomes;
+    parseChromosomes(vm["chromosome"].as<string>(), chromosomes);
 
-    BranchPointGroups BG(SA, reads, 
+    if (!vm["trace-out"].as<string>().empty()) {
+      Trace::enable();
+    }
+    if (vm["perf-counters"].as<bool>()) {
+      PerfCounters::enable();
+    }
+    // All parallel work of the stages runs on the one process wide pool
+    ThreadPool::init(n_threads, vm["pin_threads"].as<bool>());
+    TaskGraph pipeline;
+    pipeline.addStage("reads", {}, [&]() {
+      reads.reset(new ReadsManipulator(
+          TaskGraph::stageThreads(stage_threads, "reads", n_threads),
+          vm["input_files"].as<string>()));
+      Metrics::global().setItems("reads", 
+          reads->getSize(TUMOUR) + reads->getSize(HEALTHY), "reads");
+    });
+    pipeline.addStage("sa", {"reads"}, [&]() {
+      SA.reset(new SuffixArray(*reads, reads->getMinSuffixSize(), 
+          TaskGraph::stageThreads(stage_threads, "sa", n_threads)));
+      Metrics::global().setItems("sa", SA->getSize(), "suffixes");
+    });
+    pipeline.addStage("seeds", {"sa"}, [&]() {
+      BG.reset(new BranchPointGroups(*SA, *reads, 
                          vm["min_phred"].as<int>()+BASE33_CONVERSION,
                          vm["gsa1_mct"].as<int>(),
                          vm["gsa2_mct"].as<int>(),
                          vm["expected_coverage"].as<int>()*CALIB,
-                         vm["n_threads"].as<int>(),
+                         TaskGraph::stageThreads(stage_threads, "seeds", n_threads),
                          vm["max_low_confidence_positions"].as<int>(),
                          vm["expected_contamination"].as<double>(),
-                         vm["max_allele_freq_of_error"].as<double>());
-
-    GenomeMapper mapper(BG, reads,
+                         vm["max_allele_freq_of_error"].as<double>()));
+      mapper.reset(new GenomeMapper(*BG, *reads,
                         vm["output_path"].as<string>(),
                         vm["output_basename"].as<string>(),
-                        vm["chromosome"].as<string>(),
+                        chromosomes,
+                        vm["split_by_chromosome"].as<bool>(),
                         vm["bt2-idx"].as<string>(),
-                        vm["min_mapq"].as<int>());
+                        vm["min_mapq"].as<int>()));
+      Metrics::global().setItems("seeds", BG->nSeedBlocks(), "blocks");
+    });
+    pipeline.addStage("consensus", {"seeds"}, [&]() {
+      BG->buildConsensusPairs(
+          TaskGraph::stageThreads(stage_threads, "consensus", n_threads),
+          &pair_stream);
+      Metrics::global().setItems("consensus", BG->nSeedBlocks(), "blocks");
+    });
+    if (aligner_name == "bwa") {
+      // The bwa index loads while the reads and suffix arrays are built
+      pipeline.addStage("index", {}, [&]() {
+        aligner.reset(new BwaAligner(vm["bt2-idx"].as<string>()));
+      });
+      pipeline.addStage("align", {"seeds", "index"}, [&]() {
+        mapper->alignInMemory(pair_stream, *aligner,
+            TaskGraph::stageThreads(stage_threads, "align", n_threads));
+        Metrics::global().setItems("align", mapper->pairsAligned(), "pairs");
+      });
+    }
+    else if (aligner_name == "bowtie2") {
+      pipeline.addStage("align", {"seeds"}, [&]() {
+        mapper->alignStreaming(pair_stream,
+            TaskGraph::stageThreads(stage_threads, "align", n_threads));
+        Metrics::global().setItems("align", mapper->pairsAligned(), "pairs");
+      });
+    }
+    else {
+      pipeline.addStage("fastq", {"seeds"}, [&]() {
+        mapper->writeFastq(pair_stream);
+        Metrics::global().setItems("fastq", mapper->pairsAligned(), "pairs");
+      });
+      pipeline.addStage("align", {"fastq"}, [&]() {
+        mapper->alignFastq(
+            TaskGraph::stageThreads(stage_threads, "align", n_threads));
+        Metrics::global().setItems("align", mapper->pairsAligned(), "pairs");
+      });
+    }
+    // snv joins alignments to the consensus pairs by pair_id, so needs
+    // all the pairs built
+    pipeline.addStage("snv", {"align", "consensus"}, [&]() {
+      mapper->callSNVs(
+          TaskGraph::stageThreads(stage_threads, "snv", n_threads));
+      Metrics::global().setItems("snv", mapper->alignmentsCalled(), 
+                                 "alignments");
+    });
+    pipeline.run();
+
+    Metrics::global().printSummary();
+    MemoryTracker::global().printPeak();
+    if (!vm["metrics-out"].as<string>().empty()) {
+      Metrics::global().write(vm["metrics-out"].as<string>());
+    }
+    if (!vm["trace-out"].as<string>().empty()) {
+      Trace::write(vm["trace-out"].as<string>());
+    }
     return SUCCESS;
   } 
   catch(std::exception& e) 
@@ -22,6 +22,7 @@
 
 #include "utils.h"
 #include "RadixLSDCache.h"
+#include "Trace.h"
 
 template<class unum>
 class Radix {
@@ -431,6 +432,7 @@ private:
 
         const int allowedRepeats = 128;
         do {
+            Trace::Span pass("radix refinement pass", "depth", expectedSorted);
             bool done = true;
             unum prevBLen = 0;
             unum prevBStart = 0;
@@ -524,7 +526,11 @@ private:
     // This is done in two or three passes. The first pass bucket sorts by bitsPerFirstPass bits.
     // The second and third pass further subdivides the buckets obtained in the first pass, by the next word of each suffix.
     void inputBasedSort(uint *charCode, int bitsPerChar, int bitsPerFirstPass, bool doThirdPass) {
-        vector<unum> bStartVec = sortByFirstBits(charCode, bitsPerChar, bitsPerFirstPass);
+        vector<unum> bStartVec;
+        {
+            Trace::Span span("radix first pass");
+            bStartVec = sortByFirstBits(charCode, bitsPerChar, bitsPerFirstPass);
+        }
 
         bucketFlag = vector<uchar>(length + 1);
         bucketFlag[0] = bucketFlag[length] = 1;
@@ -553,9 +559,13 @@ private:
 
         RadixLSDCache<unum, word, unum> sorter;
 
-        sortBuckets(bitsPerFirstPass, n, &bStartVec[0], bitsPerChar, input, buffer, sorter);
+        {
+            Trace::Span span("radix second pass");
+            sortBuckets(bitsPerFirstPass, n, &bStartVec[0], bitsPerChar, input, buffer, sorter);
+        }
 
         if (doThirdPass) {
+            Trace::Span span("radix third pass");
             sortFlagBuckets(bitsPerFirstPass + bitsPerWord, &bucketFlag[0], 0, length, bitsPerChar,
                     input, buffer, sorter);
         }
@@ -619,6 +629,13 @@ public:
         return sa;
     }
 
+    // Bytes held by the bucket arrays built for build(), which are
+    // freed with this object. Does not count the returned suffix array.
+    size_t bucketBytes() const {
+        return bucket.capacity() * sizeof(unum) + bucketFlag.capacity() +
+               (indexBuff1.capacity() + indexBuff2.capacity()) * sizeof(unum);
+    }
+
 private:
     // Places into singleton buckets all suffixes that contain only zeros.
     // Naturally, these suffixes will be at the beginning of the suffix array.
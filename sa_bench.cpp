@@ -0,0 +1,109 @@
+// sa_bench.cpp: compares the suffix array engines. Built by `make sa-bench`
+//   GeDiSABench [--sizes 1M,10M,100M] [--engines parallel_radix,...]
+//               [--threads 1,2,4] [--max-merge-sort 10M]
+// sizes are bases per read set, with an optional K, M or G suffix. The
+// speedup of a build is over the first thread count of its engine
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "SAEngineBenchmarks.h"
+#include "string.h"     // split_string()
+
+using namespace std;
+
+static unsigned long long parseBases(string const& s) {
+  char *end;
+  unsigned long long n = strtoull(s.c_str(), &end, 10);
+  string unit = end;
+  if (unit == "K" || unit == "k") return n * 1000ULL;
+  if (unit == "M" || unit == "m") return n * 1000000ULL;
+  if (unit == "G" || unit == "g") return n * 1000000000ULL;
+  if (!unit.empty() || n == 0) {
+    throw invalid_argument("bad size " + s);
+  }
+  return n;
+}
+
+static vector<string> list(string const& s) {
+  vector<string> items;
+  split_string(s, ",", items);
+  return items;
+}
+
+int main(int argc, char **argv) {
+  vector<unsigned long long> sizes = {1000000, 10000000, 100000000};
+  vector<sa_engine> engines = {SA_PARALLEL_RADIX, SA_MERGE_RADIX,
+                               SA_MERGE_SORT};
+  vector<int> thread_counts;
+  unsigned long long max_merge_sort = 10000000;
+  int hardware_threads = max(1u, thread::hardware_concurrency());
+  for (int n = 1; n < hardware_threads; n *= 2) {
+    thread_counts.push_back(n);
+  }
+  thread_counts.push_back(hardware_threads);
+
+  try {
+    for (int i = 1; i < argc; i++) {
+      string arg = argv[i];
+      if (i + 1 == argc) {
+        throw invalid_argument(arg + " needs a value");
+      }
+      string value = argv[++i];
+      if (arg == "--sizes") {
+        sizes.clear();
+        for (string const& size : list(value)) {
+          sizes.push_back(parseBases(size));
+        }
+      }
+      else if (arg == "--engines") {
+        engines.clear();
+        for (string const& name : list(value)) {
+          int e = 0;
+          while (e < N_SA_ENGINES && name != SuffixArray::engineName(e)) e++;
+          if (e == N_SA_ENGINES) {
+            throw invalid_argument("unknown engine " + name);
+          }
+          engines.push_back((sa_engine) e);
+        }
+      }
+      else if (arg == "--threads") {
+        thread_counts.clear();
+        for (string const& n : list(value)) {
+          if (atoi(n.c_str()) < 1) {
+            throw invalid_argument("bad thread count " + n);
+          }
+          thread_counts.push_back(atoi(n.c_str()));
+        }
+      }
+      else if (arg == "--max-merge-sort") {
+        max_merge_sort = parseBases(value);
+      }
+      else {
+        throw invalid_argument("unknown option " + arg);
+      }
+    }
+    if (sizes.empty() || engines.empty() || thread_counts.empty()) {
+      throw invalid_argument("empty list");
+    }
+  }
+  catch (invalid_argument &e) {
+    cerr << e.what() << endl << "usage: " << argv[0]
+         << " [--sizes 1M,10M,100M] [--engines parallel_radix,merge_radix,"
+         << "merge_sort] [--threads 1,2,4] [--max-merge-sort 10M]" << endl;
+    return 1;
+  }
+
+  try {
+    SAEngineBenchmarks benchmarks(sizes, engines, thread_counts,
+                                  max_merge_sort);
+    return benchmarks.run() ? 0 : 3;
+  }
+  catch (exception &e) {
+    cerr << "Benchmark failed: " << e.what() << endl;
+    return 2;
+  }
+}
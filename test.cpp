@@ -0,0 +1,21 @@
+// test.cpp: runs the pipeline tests. Built and run by `make test`
+#include <iostream>
+#include <stdexcept>
+
+#include "PipelineTests.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+int main() {
+  // two workers, so a stage's parallel work and its consumer overlap
+  ThreadPool::init(2, false);
+  try {
+    PipelineTests tests;
+    return tests.run() ? 0 : 1;
+  }
+  catch (exception &e) {
+    cerr << "Tests failed to set up: " << e.what() << endl;
+    return 2;
+  }
+}
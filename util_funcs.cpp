@@ -1,31 +1,72 @@
 // util_funcs.cpp
 #include <string>
+#include <cstring>  // memcpy
+#include <stdint.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 #include "Suffix_t.h"
 #include "util_funcs.h"
 #include "Reads.h"
+#include "OpCounters.h"
 
 using namespace std;
 
 int computeLCP(Suffix_t &isuf, Suffix_t &jsuf, ReadsManipulator &reads) {
 
   // Get suffix pointers in reads
-  string::iterator isuf_iter  = reads.returnStartIterator(isuf);
-  string::iterator isuf_end   = reads.returnEndIterator(isuf);
-  string::iterator jsuf_iter  = reads.returnStartIterator(jsuf);
-  string::iterator jsuf_end   = reads.returnEndIterator(jsuf);
+  string const& iread = reads.getReadByIndex(isuf.read_id, isuf.type);
+  string const& jread = reads.getReadByIndex(jsuf.read_id, jsuf.type);
 
   // computes lcp
+  return lcpKernel(iread.data() + isuf.offset, iread.size() - isuf.offset,
+                   jread.data() + jsuf.offset, jread.size() - jsuf.offset);
+}
+
+static inline int matchingPrefix(char const* a, char const* b, int n) {
   int lcp = 0;
 
-  while (isuf_iter != isuf_end &&
-         jsuf_iter != jsuf_end && 
-         *isuf_iter == *jsuf_iter) {
+#ifdef __AVX2__
+  // 32 characters per step
+  for (; lcp + 32 <= n; lcp += 32) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(a + lcp));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(b + lcp));
+    unsigned int eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+    if (eq != 0xFFFFFFFFu) {
+      return lcp + __builtin_ctz(~eq);
+    }
+  }
+#endif
 
-    lcp++;      // matched next char, so extend lcp
+  // 8 characters per step. The first differing byte is located from the
+  // XOR of both words.
+  for (; lcp + 8 <= n; lcp += 8) {
+    uint64_t wa, wb;
+    memcpy(&wa, a + lcp, sizeof(wa));   // unaligned safe loads
+    memcpy(&wb, b + lcp, sizeof(wb));
+    uint64_t diff = wa ^ wb;
+    if (diff) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      return lcp + (__builtin_clzll(diff) >> 3);
+#else
+      return lcp + (__builtin_ctzll(diff) >> 3);
+#endif
+    }
+  }
 
-    isuf_iter++; jsuf_iter++;
+  // tail
+  while (lcp < n && a[lcp] == b[lcp]) {
+    lcp++;
   }
+  return lcp;
+}
 
-  return (lcp);   
+int lcpKernel(char const* a, int a_len, char const* b, int b_len) {
+  int n = (a_len < b_len) ? a_len : b_len;
+  int lcp = matchingPrefix(a, b, n);
+  OpCounters::add(OP_LCP_CALLS);
+  OpCounters::add(OP_LCP_CHARS, (lcp < n) ? lcp + 1 : lcp);  // + mismatch
+  return lcp;
 }
@@ -18,6 +18,39 @@ static const int MIN_SUFFIX = 30;
 
 int computeLCP(Suffix_t &isuf, Suffix_t &jsuf, ReadsManipulator &reads);
 // Returns the longest common prefix between isuf and jsuf suffixes
+
+inline char complementBase(char c) {
+  switch (c) {
+    case 'A': return 'T';
+    case 'T': return 'A';
+    case 'C': return 'G';
+    case 'G': return 'C';
+    default:  return c;
+  }
+}
+// Returns the Watson-Crick complement of c. Other characters are returned
+// unchanged.
+
+static const char BASES[] = "ACGT";
+
+inline char otherBase(char base, int shift) {
+  switch (base) {
+    case 'A': return BASES[shift % 4];
+    case 'C': return BASES[(1 + shift) % 4];
+    case 'G': return BASES[(2 + shift) % 4];
+    case 'T': return BASES[(3 + shift) % 4];
+    default:  return base;
+  }
+}
+// Returns the base shift places after base in BASES, so shifts 1 to 3 give
+// the three bases that are not base. Other characters are returned
+// unchanged.
+
+int lcpKernel(char const* a, int a_len, char const* b, int b_len);
+// Returns the number of leading characters a[0..a_len) and b[0..b_len)
+// have in common. Compares a machine word (or an AVX2 register, when
+// compiled with -mavx2) of characters per step. Reads are '$' terminated,
+// so the lengths bound the comparison exactly at the end of each read.
 struct mutation_classes{
   std::vector<int> SNV_pos;
 };